@@ -0,0 +1,139 @@
+#include <RotaryEncoder.h>
+
+#include "quadrature.h"
+
+// Compares the cycle counts of the PCINT2 (PIND) encoder handling on PCB_VERSION 3:
+// the RotaryEncoder based Slave_::tickEncoder path against the port-wide table decoder.
+// The encoder pins are driven as outputs so that both paths see real transitions.
+// Run on a bare slave board (nothing connected to the encoder pins) and read the
+// results from the serial port.
+
+#if PCB_VERSION != 3
+#error "The benchmark expects the PCB_VERSION 3 pinout"
+#endif
+
+const uint8_t ENCODER_COUNT = 3;
+const uint16_t ITERATIONS = 1000;
+
+const uint8_t ENCODER_PINS[ENCODER_COUNT][2] = {
+  {ENCM1A, ENCM1B},
+  {ENCL2A, ENCL2B},
+  {ENCR1A, ENCR1B}
+};
+
+#define ENCODER_PIN_MASK(PIN) (1 << digitalPinToPCMSKbit(PIN))
+const uint8_t ENCODER_PIN_MASKS[ENCODER_COUNT][2] = {
+  {ENCODER_PIN_MASK(ENCM1A), ENCODER_PIN_MASK(ENCM1B)},
+  {ENCODER_PIN_MASK(ENCL2A), ENCODER_PIN_MASK(ENCL2B)},
+  {ENCODER_PIN_MASK(ENCR1A), ENCODER_PIN_MASK(ENCR1B)}
+};
+
+// One full detent, state = A | (B << 1)
+const uint8_t QUADRATURE_SEQUENCE[] = {2, 0, 1, 3};
+
+RotaryEncoder* rotaryEncoders[ENCODER_COUNT] = {
+  new RotaryEncoder(ENCODER_PINS[0][0], ENCODER_PINS[0][1]),
+  new RotaryEncoder(ENCODER_PINS[1][0], ENCODER_PINS[1][1]),
+  new RotaryEncoder(ENCODER_PINS[2][0], ENCODER_PINS[2][1])
+};
+
+QuadratureEncoder quadratureEncoders[ENCODER_COUNT];
+
+struct CycleStats {
+  uint16_t min;
+  uint16_t max;
+  uint32_t total;
+};
+
+void __attribute__((noinline)) tickEncoder(uint8_t encoder) {
+  (*(rotaryEncoders)[encoder]).tick();
+}
+
+void __attribute__((noinline)) baseline() {
+}
+
+void __attribute__((noinline)) tickRotaryEncoders() {
+  tickEncoder(0);
+  tickEncoder(1);
+  tickEncoder(2);
+}
+
+inline void decodeEncoder(uint8_t encoder, uint8_t portPins) {
+  quadratureEncoders[encoder].tick(((portPins & ENCODER_PIN_MASKS[encoder][0]) ? 1 : 0) | ((portPins & ENCODER_PIN_MASKS[encoder][1]) ? 2 : 0));
+}
+
+void __attribute__((noinline)) decodeQuadratureEncoders() {
+  const uint8_t portPins = PIND;
+  decodeEncoder(0, portPins);
+  decodeEncoder(1, portPins);
+  decodeEncoder(2, portPins);
+}
+
+void writeEncoderPins(uint8_t state) {
+  for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
+    digitalWrite(ENCODER_PINS[i][0], state & 1 ? HIGH : LOW);
+    digitalWrite(ENCODER_PINS[i][1], state & 2 ? HIGH : LOW);
+  }
+}
+
+uint16_t measureCycles(void (*function)()) {
+  uint8_t oldSREG = SREG;
+  cli();
+  TCNT1 = 0;
+  function();
+  uint16_t cycles = TCNT1;
+  SREG = oldSREG;
+  return cycles;
+}
+
+CycleStats measure(void (*function)()) {
+  CycleStats stats = {UINT16_MAX, 0, 0};
+  for (uint16_t i = 0; i < ITERATIONS; ++i) {
+    writeEncoderPins(QUADRATURE_SEQUENCE[i % sizeof(QUADRATURE_SEQUENCE)]);
+    uint16_t cycles = measureCycles(function);
+    stats.min = min(stats.min, cycles);
+    stats.max = max(stats.max, cycles);
+    stats.total += cycles;
+  }
+  return stats;
+}
+
+void printStats(const char* name, CycleStats stats, uint16_t overhead) {
+  Serial.print(name);
+  Serial.print(": min ");
+  Serial.print(stats.min - overhead);
+  Serial.print(", max ");
+  Serial.print(stats.max - overhead);
+  Serial.print(", avg ");
+  Serial.println(stats.total / ITERATIONS - overhead);
+}
+
+void setup() {
+  for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
+    pinMode(ENCODER_PINS[i][0], OUTPUT);
+    pinMode(ENCODER_PINS[i][1], OUTPUT);
+  }
+  writeEncoderPins(QUADRATURE_LATCH_STATE);
+
+  // Timer1 without prescaler counts CPU cycles
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+
+  const uint16_t overhead = measure(baseline).min;
+  const CycleStats rotaryEncoderStats = measure(tickRotaryEncoders);
+  const CycleStats quadratureEncoderStats = measure(decodeQuadratureEncoders);
+
+  // L2 uses the USART pins, start serial only after the measurements
+  Serial.begin(115200);
+  Serial.println("Cycles per PCINT2 interrupt (3 encoders)");
+  printStats("tickEncoder", rotaryEncoderStats, overhead);
+  printStats("Port decoder", quadratureEncoderStats, overhead);
+
+  Serial.print("Positions: ");
+  Serial.print(rotaryEncoders[0]->getPosition());
+  Serial.print(" / ");
+  Serial.println(quadratureEncoders[0].getPosition());
+}
+
+void loop() {
+}
@@ -0,0 +1 @@
+../slave/quadrature.h
\ No newline at end of file
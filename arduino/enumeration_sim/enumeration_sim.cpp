@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef uint8_t byte;
+#include "../shared.h"
+#include "../master/address_enumerator.h"
+
+// Bring-up time of N slaves that power up together and ask for their addresses with the
+// unique id enumeration (shared.h), with the master's AddressEnumerator answering. Models the
+// bus at bit level: transaction times, slaves waiting for a busy bus and the arbitration
+// between slaves that start at the same time. The old scheme (one byte read of nextAddress)
+// is shown for comparison: slaves that read at the same time get the same address.
+//   make && ./enumeration_sim [-c I2C clock Hz] [-j power-up spread us] [-r runs]
+
+static uint32_t clockHz = 100000;
+static uint32_t powerUpSpreadMicros = 1000;
+static uint16_t runs = 20;
+
+// Master clock stretching while its Wire interrupt handles a byte
+static const uint32_t BYTE_STRETCH_MICROS = 4;
+static const uint32_t SETUP_DELAY_MICROS = 10000; // delay(10) in Slave_::setup()
+static const uint32_t LEGACY_RECEIVED_ADDRESS_DELAY_MICROS = 900000;
+static const uint8_t BOARD_COUNTS[] = {1, 10, 50, 100, SLAVE_ADDRESS_COUNT};
+
+struct Slave {
+  uint8_t uniqueId[UNIQUE_ID_SIZE];
+  uint32_t nextAttemptMicros;
+  uint8_t failures;
+  uint8_t address;
+  std::minstd_rand random;
+};
+
+struct RunResult {
+  uint32_t bringUpMicros;
+  uint32_t collisions;
+  uint8_t maxFailures;
+  uint8_t duplicateAddresses;
+};
+
+// Feeds a request to the enumerator and collects its response like Wire does
+struct Buffer {
+  uint8_t data[ADDRESS_REQUEST_SIZE > ADDRESS_RESPONSE_SIZE ? ADDRESS_REQUEST_SIZE : ADDRESS_RESPONSE_SIZE];
+  uint8_t length = 0;
+  uint8_t index = 0;
+
+  int available() { return length - index; }
+  int read() { return data[index++]; }
+  size_t write(const uint8_t* bytes, size_t quantity) {
+    memcpy(data + length, bytes, quantity);
+    length += quantity;
+    return quantity;
+  }
+};
+
+static uint32_t bitMicros(uint32_t bits) {
+  return (bits * 1000000 + clockHz - 1) / clockHz;
+}
+
+static uint32_t bytesMicros(uint32_t bytes) {
+  return bitMicros(9 * bytes) + bytes * BYTE_STRETCH_MICROS;
+}
+
+// START, address + request, repeated START, address + response, STOP
+static uint32_t transactionMicros() {
+  return bitMicros(3) + bytesMicros(1 + ADDRESS_REQUEST_SIZE) + bytesMicros(1 + ADDRESS_RESPONSE_SIZE);
+}
+
+static void powerUp(std::vector<Slave>& slaves, std::mt19937& random) {
+  std::uniform_int_distribution<uint32_t> powerUpMicros(0, powerUpSpreadMicros);
+  for (Slave& slave : slaves) {
+    const uint32_t id = random();
+    for (uint8_t i = 0; i < UNIQUE_ID_SIZE; ++i) {
+      slave.uniqueId[i] = id >> (8 * i);
+    }
+    slave.uniqueId[0] &= 0x7F;
+    slave.nextAttemptMicros = SETUP_DELAY_MICROS + powerUpMicros(random);
+    slave.failures = 0;
+    slave.address = NO_ADDRESS;
+    slave.random.seed(id);
+  }
+}
+
+// Slaves that want the bus while it is busy all start when it frees up
+static std::vector<Slave*> nextContenders(std::vector<Slave>& slaves, uint32_t busFreeMicros, uint32_t& startMicros) {
+  startMicros = UINT32_MAX;
+  for (const Slave& slave : slaves) {
+    if (slave.address == NO_ADDRESS) {
+      startMicros = std::min(startMicros, std::max(slave.nextAttemptMicros, busFreeMicros));
+    }
+  }
+  std::vector<Slave*> contenders;
+  for (Slave& slave : slaves) {
+    if (slave.address == NO_ADDRESS && slave.nextAttemptMicros <= startMicros) {
+      contenders.push_back(&slave);
+    }
+  }
+  return contenders;
+}
+
+static uint8_t countDuplicates(const std::vector<Slave>& slaves) {
+  uint8_t duplicates = 0;
+  for (size_t i = 0; i < slaves.size(); ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      if (slaves[i].address == slaves[j].address) {
+        duplicates++;
+        break;
+      }
+    }
+  }
+  return duplicates;
+}
+
+static RunResult enumerate(uint8_t boardCount, std::mt19937& random) {
+  std::vector<Slave> slaves(boardCount);
+  powerUp(slaves, random);
+  AddressEnumerator master;
+  volatile uint8_t nextAddress = FIRST_SLAVE_ADDRESS;
+  RunResult result = {0, 0, 0, 0};
+  uint32_t busFreeMicros = 0;
+
+  for (uint8_t done = 0; done < boardCount;) {
+    uint32_t startMicros;
+    std::vector<Slave*> contenders = nextContenders(slaves, busFreeMicros, startMicros);
+    // Arbitration: the lowest id as sent on the bus keeps it
+    Slave* winner = *std::min_element(contenders.begin(), contenders.end(), [](const Slave* a, const Slave* b) {
+      return memcmp(a->uniqueId, b->uniqueId, UNIQUE_ID_SIZE) < 0;
+    });
+    busFreeMicros = startMicros + transactionMicros();
+
+    Buffer request;
+    request.data[request.length++] = ADDRESS_REQUEST_COMMAND;
+    request.write(winner->uniqueId, UNIQUE_ID_SIZE);
+    master.handleRequest(request, nextAddress);
+    Buffer response;
+    master.writeResponse(response);
+    if (memcmp(response.data, winner->uniqueId, UNIQUE_ID_SIZE) == 0 && isValidSlaveAddress(response.data[UNIQUE_ID_SIZE])) {
+      winner->address = response.data[UNIQUE_ID_SIZE];
+      result.bringUpMicros = busFreeMicros;
+      done++;
+    } else {
+      winner->nextAttemptMicros = busFreeMicros + 1000 * (1 + winner->random() % addressRequestBackoffMillis(winner->failures));
+      winner->failures++;
+    }
+
+    // The others drop out at the first id byte that differs from the winner's
+    for (Slave* slave : contenders) {
+      if (slave == winner) {
+        continue;
+      }
+      uint8_t sameBytes = 0;
+      while (sameBytes < UNIQUE_ID_SIZE - 1 && slave->uniqueId[sameBytes] == winner->uniqueId[sameBytes]) {
+        sameBytes++;
+      }
+      const uint32_t lostMicros = startMicros + bitMicros(1) + bytesMicros(2 + sameBytes);
+      slave->nextAttemptMicros = lostMicros + 1000 * (1 + slave->random() % addressRequestBackoffMillis(slave->failures));
+      slave->failures++;
+      result.maxFailures = std::max(result.maxFailures, slave->failures);
+      result.collisions++;
+    }
+  }
+  result.duplicateAddresses = countDuplicates(slaves);
+  return result;
+}
+
+// Old scheme: Wire.requestFrom(MASTER_ADDRESS, 1), the master answers nextAddress++
+static RunResult enumerateLegacy(uint8_t boardCount, std::mt19937& random) {
+  std::vector<Slave> slaves(boardCount);
+  powerUp(slaves, random);
+  uint8_t nextAddress = FIRST_SLAVE_ADDRESS;
+  RunResult result = {0, 0, 0, 0};
+  uint32_t busFreeMicros = 0;
+
+  for (uint8_t done = 0; done < boardCount;) {
+    uint32_t startMicros;
+    std::vector<Slave*> contenders = nextContenders(slaves, busFreeMicros, startMicros);
+    // All readers send the same address byte and get the same answer
+    busFreeMicros = startMicros + bitMicros(2) + bytesMicros(2);
+    for (Slave* slave : contenders) {
+      slave->address = nextAddress;
+      done++;
+    }
+    result.collisions += contenders.size() - 1;
+    nextAddress++;
+  }
+  result.bringUpMicros = busFreeMicros + LEGACY_RECEIVED_ADDRESS_DELAY_MICROS;
+  result.duplicateAddresses = countDuplicates(slaves);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-c") == 0) {
+      clockHz = atol(argv[i + 1]);
+    } else if (strcmp(argv[i], "-j") == 0) {
+      powerUpSpreadMicros = atol(argv[i + 1]);
+    } else if (strcmp(argv[i], "-r") == 0) {
+      runs = atoi(argv[i + 1]);
+    }
+  }
+
+  printf("%u Hz I2C, power-up spread %u us, %u runs per row, %u us per request\n", clockHz, powerUpSpreadMicros, runs, transactionMicros());
+  printf("boards | bring-up ms mean / max | collisions | max failures | duplicates || old: bring-up ms | duplicates\n");
+  uint8_t failures = 0;
+  for (uint8_t boardCount : BOARD_COUNTS) {
+    std::mt19937 random(boardCount);
+    uint64_t totalMicros = 0, legacyMicros = 0;
+    uint32_t maxMicros = 0, collisions = 0, duplicates = 0, legacyDuplicates = 0;
+    uint8_t maxFailures = 0;
+    for (uint16_t run = 0; run < runs; ++run) {
+      const RunResult result = enumerate(boardCount, random);
+      totalMicros += result.bringUpMicros;
+      maxMicros = std::max(maxMicros, result.bringUpMicros);
+      collisions += result.collisions;
+      maxFailures = std::max(maxFailures, result.maxFailures);
+      duplicates += result.duplicateAddresses;
+
+      const RunResult legacy = enumerateLegacy(boardCount, random);
+      legacyMicros += legacy.bringUpMicros;
+      legacyDuplicates += legacy.duplicateAddresses;
+    }
+    printf("%6u | %11.1f / %6.1f | %10.1f | %12u | %10u || %16.1f | %10.1f\n", boardCount,
+      totalMicros / 1000.0 / runs, maxMicros / 1000.0, (double) collisions / runs, maxFailures, duplicates,
+      legacyMicros / 1000.0 / runs, (double) legacyDuplicates / runs);
+    failures += duplicates ? 1 : 0;
+  }
+  return failures;
+}
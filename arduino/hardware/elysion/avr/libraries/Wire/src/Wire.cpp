@@ -86,6 +86,45 @@ void TwoWire::setClock(uint32_t clock)
   twi_setFrequency(clock);
 }
 
+//	Receives the writes to the general call address (0) with
+//	onReceive() too. begin() turns it off again.
+//
+void TwoWire::setGeneralCall(bool enable)
+{
+  twi_setGeneralCall(enable);
+}
+
+//	Sets how long a transmission or request may wait for the bus,
+//	in microseconds (0 waits forever). endTransmission() then
+//	returns 5 and requestFrom() 0 when it expires. With
+//	reset_with_timeout the bus is freed (see twi_recoverBus) and
+//	the TWI hardware reinitialized, so a stuck bus can't hang
+//	the sketch.
+//
+void TwoWire::setWireTimeout(uint32_t timeout, bool reset_with_timeout)
+{
+  twi_setTimeoutInMicros(timeout, reset_with_timeout);
+}
+
+//	Whether a timeout happened since the flag was last cleared
+//
+bool TwoWire::getWireTimeoutFlag(void)
+{
+  return twi_manageTimeoutFlag(false);
+}
+
+void TwoWire::clearWireTimeoutFlag(void)
+{
+  twi_manageTimeoutFlag(true);
+}
+
+//	Timeouts, bus errors, lost arbitrations, NACKs and bus recoveries since boot
+//
+void TwoWire::getErrorCounts(WireErrorCounts& counts)
+{
+  twi_getErrorCounts(&counts);
+}
+
 uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint32_t iaddress, uint8_t isize, uint8_t sendStop)
 {
   if (isize > 0) {
@@ -187,6 +226,37 @@ uint8_t TwoWire::endTransmission(void)
   return endTransmission(true);
 }
 
+//	Starts transmitting the buffer and returns without waiting for
+//	the bus. The result is available from transmitStatus() or the
+//	onTransmitComplete() callback once the transmission is done.
+//	Returns 0 when the transmission was started, 1 if the data does
+//	not fit the twi buffer and 5 if the twi is busy with another
+//	transfer (nothing is sent, the buffer can be retried later).
+//
+uint8_t TwoWire::endTransmissionAsync(uint8_t sendStop)
+{
+  uint8_t ret = twi_writeToAsync(txAddress, txBuffer, txBufferLength, sendStop);
+  // reset tx buffer iterator vars
+  txBufferIndex = 0;
+  txBufferLength = 0;
+  // indicate that we are done transmitting
+  transmitting = 0;
+  return ret;
+}
+
+uint8_t TwoWire::endTransmissionAsync(void)
+{
+  return endTransmissionAsync(true);
+}
+
+//	WIRE_TRANSMIT_PENDING while an asynchronous transmission is in
+//	progress, otherwise the endTransmission result code of the last one
+//
+uint8_t TwoWire::transmitStatus(void)
+{
+  return twi_writeStatus();
+}
+
 // must be called in:
 // slave tx event callback
 // or after beginTransmission(address)
@@ -325,6 +395,13 @@ void TwoWire::onRequest( void (*function)(void) )
   user_onRequest = function;
 }
 
+// sets function called from the twi interrupt when an
+// asynchronous transmission completes
+void TwoWire::onTransmitComplete( void (*function)(uint8_t) )
+{
+  twi_attachMasterTxCompleteEvent(function);
+}
+
 // Preinstantiate Objects //////////////////////////////////////////////////////
 
 TwoWire Wire = TwoWire();
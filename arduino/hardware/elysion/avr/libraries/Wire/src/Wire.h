@@ -24,12 +24,32 @@
 
 #include <inttypes.h>
 #include "Stream.h"
+extern "C" {
+  #include "utility/twi.h"
+}
 
 #define BUFFER_LENGTH 32
 
 // WIRE_HAS_END means Wire has end()
 #define WIRE_HAS_END 1
 
+// WIRE_HAS_ASYNC_TRANSMIT means Wire has endTransmissionAsync()
+#define WIRE_HAS_ASYNC_TRANSMIT 1
+
+// returned by transmitStatus() while an asynchronous transmission is in progress
+#define WIRE_TRANSMIT_PENDING 0xFF
+
+// WIRE_HAS_TIMEOUT means Wire has setWireTimeout(), getWireTimeoutFlag() and clearWireTimeoutFlag()
+#define WIRE_HAS_TIMEOUT 1
+
+// WIRE_HAS_ERROR_COUNTS means Wire has getErrorCounts()
+#define WIRE_HAS_ERROR_COUNTS 1
+
+// WIRE_HAS_GENERAL_CALL means Wire has setGeneralCall()
+#define WIRE_HAS_GENERAL_CALL 1
+
+typedef twi_errorCounts_t WireErrorCounts;
+
 class TwoWire : public Stream
 {
   private:
@@ -54,10 +74,18 @@ class TwoWire : public Stream
     void begin(int);
     void end();
     void setClock(uint32_t);
+    void setGeneralCall(bool);
+    void setWireTimeout(uint32_t timeout = 25000, bool reset_with_timeout = false);
+    bool getWireTimeoutFlag(void);
+    void clearWireTimeoutFlag(void);
+    void getErrorCounts(WireErrorCounts&);
     void beginTransmission(uint8_t);
     void beginTransmission(int);
     uint8_t endTransmission(void);
     uint8_t endTransmission(uint8_t);
+    uint8_t endTransmissionAsync(void);
+    uint8_t endTransmissionAsync(uint8_t);
+    uint8_t transmitStatus(void);
     uint8_t requestFrom(uint8_t, uint8_t);
     uint8_t requestFrom(uint8_t, uint8_t, uint8_t);
 	uint8_t requestFrom(uint8_t, uint8_t, uint32_t, uint8_t, uint8_t);
@@ -71,6 +99,7 @@ class TwoWire : public Stream
     virtual void flush(void);
     void onReceive( void (*)(int) );
     void onRequest( void (*)(void) );
+    void onTransmitComplete( void (*)(uint8_t) );
 
     inline size_t write(unsigned long n) { return write((uint8_t)n); }
     inline size_t write(long n) { return write((uint8_t)n); }
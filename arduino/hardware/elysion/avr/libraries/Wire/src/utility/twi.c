@@ -25,6 +25,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <compat/twi.h>
+#include <util/delay.h>
 #include "Arduino.h" // for digitalWrite
 
 #ifndef cbi
@@ -45,6 +46,7 @@ static volatile uint8_t twi_inRepStart;			// in the middle of a repeated start
 
 static void (*twi_onSlaveTransmit)(void);
 static void (*twi_onSlaveReceive)(uint8_t*, int);
+static void (*twi_onMasterTransmitComplete)(uint8_t);
 
 static uint8_t twi_masterBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_masterBufferIndex;
@@ -58,6 +60,21 @@ static uint8_t twi_rxBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_rxBufferIndex;
 
 static volatile uint8_t twi_error;
+static volatile uint8_t twi_asyncPending;
+static volatile uint8_t twi_asyncResult;
+static volatile uint32_t twi_asyncStartMicros;
+
+// 0 .. the waits never give up
+static volatile uint32_t twi_timeoutMicros;
+static volatile uint8_t twi_resetOnTimeout;
+static volatile uint8_t twi_timedOut;
+static volatile twi_errorCounts_t twi_errorCounts;
+
+// SCL half period of the bus recovery, about 100 kHz
+#define TWI_RECOVERY_HALF_PERIOD_US 5
+
+static uint8_t twi_waitExpired(uint32_t startMicros);
+static void twi_handleTimeout(void);
 
 /* 
  * Function twi_init
@@ -71,6 +88,8 @@ void twi_init(void)
   twi_state = TWI_READY;
   twi_sendStop = true;		// default value
   twi_inRepStart = false;
+  twi_asyncPending = false;
+  twi_asyncResult = 0;
   
   // activate internal pullups for twi.
   digitalWrite(SDA, 1);
@@ -118,6 +137,21 @@ void twi_setAddress(uint8_t address)
   TWAR = address << 1;
 }
 
+/* 
+ * Function twi_setGeneralCall
+ * Desc     answers writes to the general call address (0) as well, call after twi_setAddress
+ * Input    enable: true to receive general calls
+ * Output   none
+ */
+void twi_setGeneralCall(uint8_t enable)
+{
+  if(enable){
+    TWAR |= _BV(TWGCE);
+  }else{
+    TWAR &= ~_BV(TWGCE);
+  }
+}
+
 /* 
  * Function twi_setClock
  * Desc     sets twi bit rate
@@ -154,8 +188,12 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
   }
 
   // wait until twi is ready, become master receiver
+  uint32_t startMicros = micros();
   while(TWI_READY != twi_state){
-    continue;
+    if(twi_waitExpired(startMicros)){
+      twi_handleTimeout();
+      return 0;
+    }
   }
   twi_state = TWI_MRX;
   twi_sendStop = sendStop;
@@ -193,8 +231,12 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
     TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);
 
   // wait for read operation to complete
+  startMicros = micros();
   while(TWI_MRX == twi_state){
-    continue;
+    if(twi_waitExpired(startMicros)){
+      twi_handleTimeout();
+      return 0;
+    }
   }
 
   if (twi_masterBufferIndex < length)
@@ -208,6 +250,24 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
   return length;
 }
 
+/* 
+ * Function twi_writeResult
+ * Desc     maps the error state of the last master write to a result code
+ * Input    none
+ * Output   see twi_writeTo
+ */
+static uint8_t twi_writeResult(void)
+{
+  if (twi_error == 0xFF)
+    return 0;	// success
+  else if (twi_error == TW_MT_SLA_NACK)
+    return 2;	// error: address send, nack received
+  else if (twi_error == TW_MT_DATA_NACK)
+    return 3;	// error: data send, nack received
+  else
+    return 4;	// other twi error
+}
+
 /* 
  * Function twi_writeTo
  * Desc     attempts to become twi bus master and write a
@@ -222,6 +282,7 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
  *          2 .. address send, NACK received
  *          3 .. data send, NACK received
  *          4 .. other twi error (lost bus arbitration, bus error, ..)
+ *          5 .. timeout
  */
 uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait, uint8_t sendStop)
 {
@@ -233,8 +294,12 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
   }
 
   // wait until twi is ready, become master transmitter
+  uint32_t startMicros = micros();
   while(TWI_READY != twi_state){
-    continue;
+    if(twi_waitExpired(startMicros)){
+      twi_handleTimeout();
+      return 5;
+    }
   }
   twi_state = TWI_MTX;
   twi_sendStop = sendStop;
@@ -275,18 +340,104 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
     TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);	// enable INTs
 
   // wait for write operation to complete
+  startMicros = micros();
   while(wait && (TWI_MTX == twi_state)){
-    continue;
+    if(twi_waitExpired(startMicros)){
+      twi_handleTimeout();
+      return 5;
+    }
   }
   
-  if (twi_error == 0xFF)
-    return 0;	// success
-  else if (twi_error == TW_MT_SLA_NACK)
-    return 2;	// error: address send, nack received
-  else if (twi_error == TW_MT_DATA_NACK)
-    return 3;	// error: data send, nack received
+  return twi_writeResult();
+}
+
+/* 
+ * Function twi_writeToAsync
+ * Desc     attempts to become twi bus master and starts writing a
+ *          series of bytes to a device on the bus without waiting
+ *          for the transmission to complete. The data is copied, so
+ *          the caller can reuse its buffer immediately.
+ * Input    address: 7bit i2c device address
+ *          data: pointer to byte array
+ *          length: number of bytes in array
+ *          sendStop: boolean indicating whether or not to send a stop at the end
+ * Output   0 .. transmission started, result from twi_writeStatus or
+ *               the master tx complete callback
+ *          1 .. length to long for buffer
+ *          5 .. twi busy, nothing was sent
+ */
+uint8_t twi_writeToAsync(uint8_t address, const uint8_t* data, uint8_t length, uint8_t sendStop)
+{
+  uint8_t i;
+
+  // ensure data will fit into buffer
+  if(TWI_BUFFER_LENGTH < length){
+    return 1;
+  }
+
+  // become master transmitter only if twi is ready
+  uint8_t oldSREG = SREG;
+  cli();
+  if(TWI_READY != twi_state){
+    SREG = oldSREG;
+    return 5;
+  }
+  twi_state = TWI_MTX;
+  SREG = oldSREG;
+
+  twi_sendStop = sendStop;
+  // reset error state (0xFF.. no error occured)
+  twi_error = 0xFF;
+  twi_asyncResult = TWI_WRITE_PENDING;
+  twi_asyncPending = true;
+  twi_asyncStartMicros = micros();
+
+  // initialize buffer iteration vars
+  twi_masterBufferIndex = 0;
+  twi_masterBufferLength = length;
+
+  // copy data to twi buffer
+  for(i = 0; i < length; ++i){
+    twi_masterBuffer[i] = data[i];
+  }
+
+  // build sla+w, slave device address + w bit
+  twi_slarw = TW_WRITE;
+  twi_slarw |= address << 1;
+
+  // see twi_writeTo for the repeated start handling
+  if (true == twi_inRepStart) {
+    twi_inRepStart = false;
+    do {
+      TWDR = twi_slarw;
+    } while(TWCR & _BV(TWWC));
+    TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE);	// enable INTs, but not START
+  }
   else
-    return 4;	// other twi error
+    // send start condition
+    TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);	// enable INTs
+
+  return 0;
+}
+
+/* 
+ * Function twi_writeStatus
+ * Desc     result of the last twi_writeToAsync
+ * Input    none
+ * Output   TWI_WRITE_PENDING while the transmission is in progress,
+ *          otherwise the same values as twi_writeTo
+ */
+uint8_t twi_writeStatus(void)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if(twi_asyncPending && twi_waitExpired(twi_asyncStartMicros)){
+    twi_asyncPending = false;
+    twi_asyncResult = 5;
+    twi_handleTimeout();
+  }
+  SREG = oldSREG;
+  return twi_asyncResult;
 }
 
 /* 
@@ -344,6 +495,18 @@ void twi_attachSlaveTxEvent( void (*function)(void) )
   twi_onSlaveTransmit = function;
 }
 
+/* 
+ * Function twi_attachMasterTxCompleteEvent
+ * Desc     sets function called from the twi interrupt when a
+ *          transmission started with twi_writeToAsync completes
+ * Input    function: callback function to use, gets the result code
+ * Output   none
+ */
+void twi_attachMasterTxCompleteEvent( void (*function)(uint8_t) )
+{
+  twi_onMasterTransmitComplete = function;
+}
+
 /* 
  * Function twi_reply
  * Desc     sends byte or readys receive line
@@ -373,8 +536,17 @@ void twi_stop(void)
 
   // wait for stop condition to be exectued on bus
   // TWINT is not set after a stop condition!
+  // Usually called from the interrupt where micros() stands still: counts 10 us steps instead
+  uint32_t steps = twi_timeoutMicros / 10;
   while(TWCR & _BV(TWSTO)){
-    continue;
+    if(twi_timeoutMicros > 0){
+      if(steps == 0){
+        twi_handleTimeout();
+        return;
+      }
+      _delay_us(10);
+      steps--;
+    }
   }
 
   // update twi state
@@ -396,6 +568,113 @@ void twi_releaseBus(void)
   twi_state = TWI_READY;
 }
 
+/* 
+ * Function twi_setTimeoutInMicros
+ * Desc     sets how long the waits for the bus may take, see twi_handleTimeout
+ * Input    timeout: microseconds, 0 waits forever
+ *          resetOnTimeout: recover the bus and reinitialize the twi after a timeout
+ * Output   none
+ */
+void twi_setTimeoutInMicros(uint32_t timeout, uint8_t resetOnTimeout)
+{
+  twi_timedOut = false;
+  twi_timeoutMicros = timeout;
+  twi_resetOnTimeout = resetOnTimeout;
+}
+
+/* 
+ * Function twi_manageTimeoutFlag
+ * Desc     tells whether a wait timed out since the flag was last cleared
+ * Input    clear: clear the flag
+ * Output   the flag before clearing
+ */
+uint8_t twi_manageTimeoutFlag(uint8_t clear)
+{
+  uint8_t flag = twi_timedOut;
+  if (clear){
+    twi_timedOut = false;
+  }
+  return flag;
+}
+
+/* 
+ * Function twi_getErrorCounts
+ * Desc     copies the error counters
+ * Input    counts: destination
+ * Output   none
+ */
+void twi_getErrorCounts(twi_errorCounts_t* counts)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  *counts = *(twi_errorCounts_t*) &twi_errorCounts;
+  SREG = oldSREG;
+}
+
+static uint8_t twi_waitExpired(uint32_t startMicros)
+{
+  return twi_timeoutMicros > 0 && (micros() - startMicros) > twi_timeoutMicros;
+}
+
+/* 
+ * Function twi_recoverBus
+ * Desc     releases a slave that holds SDA low because it lost clocks in the middle
+ *          of a byte: toggles SCL until SDA is released (at most 9 times), then
+ *          sends a stop condition. The pins are driven open drain by hand, the
+ *          twi module must be disabled.
+ * Input    none
+ * Output   none
+ */
+static void twi_recoverBus(void)
+{
+  uint8_t i;
+
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  _delay_us(TWI_RECOVERY_HALF_PERIOD_US);
+  for(i = 0; i < 9 && digitalRead(SDA) == LOW; ++i){
+    digitalWrite(SCL, LOW);
+    pinMode(SCL, OUTPUT);
+    _delay_us(TWI_RECOVERY_HALF_PERIOD_US);
+    pinMode(SCL, INPUT_PULLUP);
+    _delay_us(TWI_RECOVERY_HALF_PERIOD_US);
+  }
+
+  // start and stop condition: SDA falls and rises while SCL is high
+  digitalWrite(SDA, LOW);
+  pinMode(SDA, OUTPUT);
+  _delay_us(TWI_RECOVERY_HALF_PERIOD_US);
+  pinMode(SDA, INPUT_PULLUP);
+  _delay_us(TWI_RECOVERY_HALF_PERIOD_US);
+
+  twi_errorCounts.busRecoveries++;
+}
+
+/* 
+ * Function twi_handleTimeout
+ * Desc     flags the timeout and, if set up with twi_setTimeoutInMicros, frees
+ *          the bus and reinitializes the twi with the same address and bit rate
+ * Input    none
+ * Output   none
+ */
+static void twi_handleTimeout(void)
+{
+  twi_timedOut = true;
+  twi_errorCounts.timeouts++;
+
+  if (twi_resetOnTimeout){
+    uint8_t previousTWBR = TWBR;
+    uint8_t previousTWAR = TWAR;
+
+    twi_disable();
+    twi_recoverBus();
+    twi_init();
+
+    TWAR = previousTWAR;
+    TWBR = previousTWBR;
+  }
+}
+
 ISR(TWI_vect)
 {
   switch(TW_STATUS){
@@ -429,14 +708,17 @@ ISR(TWI_vect)
       }
       break;
     case TW_MT_SLA_NACK:  // address sent, nack received
+      twi_errorCounts.addressNacks++;
       twi_error = TW_MT_SLA_NACK;
       twi_stop();
       break;
     case TW_MT_DATA_NACK: // data sent, nack received
+      twi_errorCounts.dataNacks++;
       twi_error = TW_MT_DATA_NACK;
       twi_stop();
       break;
     case TW_MT_ARB_LOST: // lost bus arbitration
+      twi_errorCounts.arbitrationLost++;
       twi_error = TW_MT_ARB_LOST;
       twi_releaseBus();
       break;
@@ -468,6 +750,7 @@ ISR(TWI_vect)
 	}    
 	break;
     case TW_MR_SLA_NACK: // address sent, nack received
+      twi_errorCounts.addressNacks++;
       twi_stop();
       break;
     // TW_MR_ARB_LOST handled by TW_MT_ARB_LOST case
@@ -477,6 +760,10 @@ ISR(TWI_vect)
     case TW_SR_GCALL_ACK: // addressed generally, returned ack
     case TW_SR_ARB_LOST_SLA_ACK:   // lost arbitration, returned ack
     case TW_SR_ARB_LOST_GCALL_ACK: // lost arbitration, returned ack
+      if(TWI_MTX == twi_state || TWI_MRX == twi_state){
+        twi_errorCounts.arbitrationLost++;
+        twi_error = TW_MT_ARB_LOST;
+      }
       // enter slave receiver mode
       twi_state = TWI_SRX;
       // indicate that rx buffer can be overwritten and ack
@@ -516,6 +803,10 @@ ISR(TWI_vect)
     // Slave Transmitter
     case TW_ST_SLA_ACK:          // addressed, returned ack
     case TW_ST_ARB_LOST_SLA_ACK: // arbitration lost, returned ack
+      if(TWI_MTX == twi_state || TWI_MRX == twi_state){
+        twi_errorCounts.arbitrationLost++;
+        twi_error = TW_MT_ARB_LOST;
+      }
       // enter slave transmitter mode
       twi_state = TWI_STX;
       // ready the tx buffer index for iteration
@@ -553,9 +844,19 @@ ISR(TWI_vect)
     case TW_NO_INFO:   // no state information
       break;
     case TW_BUS_ERROR: // bus error, illegal stop/start
+      twi_errorCounts.busErrors++;
       twi_error = TW_BUS_ERROR;
       twi_stop();
       break;
   }
+
+  // report the end of an asynchronous write
+  if(twi_asyncPending && TWI_MTX != twi_state){
+    twi_asyncPending = false;
+    twi_asyncResult = twi_writeResult();
+    if(twi_onMasterTransmitComplete){
+      twi_onMasterTransmitComplete(twi_asyncResult);
+    }
+  }
 }
 
@@ -37,19 +37,38 @@
   #define TWI_MTX   2
   #define TWI_SRX   3
   #define TWI_STX   4
+
+  #define TWI_WRITE_PENDING 0xFF
+
+  // Counted since boot, read with twi_getErrorCounts
+  typedef struct {
+    uint16_t timeouts;        // waits that took longer than the twi_setTimeoutInMicros timeout
+    uint16_t busErrors;       // illegal start or stop conditions
+    uint16_t arbitrationLost; // another master won the bus
+    uint16_t addressNacks;
+    uint16_t dataNacks;
+    uint16_t busRecoveries;   // SCL toggled to release a slave that held SDA low
+  } twi_errorCounts_t;
   
   void twi_init(void);
   void twi_disable(void);
   void twi_setAddress(uint8_t);
+  void twi_setGeneralCall(uint8_t);
   void twi_setFrequency(uint32_t);
   uint8_t twi_readFrom(uint8_t, uint8_t*, uint8_t, uint8_t);
   uint8_t twi_writeTo(uint8_t, uint8_t*, uint8_t, uint8_t, uint8_t);
+  uint8_t twi_writeToAsync(uint8_t, const uint8_t*, uint8_t, uint8_t);
+  uint8_t twi_writeStatus(void);
+  void twi_attachMasterTxCompleteEvent( void (*)(uint8_t) );
   uint8_t twi_transmit(const uint8_t*, uint8_t);
   void twi_attachSlaveRxEvent( void (*)(uint8_t*, int) );
   void twi_attachSlaveTxEvent( void (*)(void) );
   void twi_reply(uint8_t);
   void twi_stop(void);
   void twi_releaseBus(void);
+  void twi_setTimeoutInMicros(uint32_t, uint8_t);
+  uint8_t twi_manageTimeoutFlag(uint8_t);
+  void twi_getErrorCounts(twi_errorCounts_t*);
 
 #endif
 
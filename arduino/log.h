@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "log_points.h"
+
+// Tokenized logging. LOG(POINT, arguments...) sends
+// [LOG_FRAME_START][log point id][argument bytes][arguments]
+// with every argument as a zigzag encoded base 128 varint (1 byte for -64..63). The host
+// decoder (log_decoder/) formats the frames with the strings in log_points.h.
+// Log points above LOG_LEVEL compile to nothing, arguments included, so the arguments must not
+// have side effects: compute them into locals first. Define LOG_LEVEL before including this,
+// the default is LOG_LEVEL_NONE.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_NONE
+#endif
+
+#ifndef LOG_STREAM
+#define LOG_STREAM Serial
+#endif
+
+const uint8_t LOG_ARGUMENT_MAX_SIZE = 5;
+
+#define LOG_POINT(name, level, format) LOG_ID_##name,
+enum LogPointId : uint8_t {
+  LOG_POINTS
+  LOG_POINT_COUNT
+};
+#undef LOG_POINT
+
+#define LOG_POINT(name, level, format) LOG_LEVEL_OF_##name = level,
+enum LogPointLevel : uint8_t {
+  LOG_POINTS
+};
+#undef LOG_POINT
+
+#define LOG(point, ...) do { \
+  if (LOG_LEVEL_OF_##point <= LOG_LEVEL) { \
+    logWrite(LOG_ID_##point, ##__VA_ARGS__); \
+  } \
+} while (0)
+
+inline uint8_t logEncodeArgument(uint8_t* data, int32_t value) {
+  uint32_t zigzag = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+  uint8_t length = 0;
+  while (zigzag >= 0x80) {
+    data[length++] = (zigzag & 0x7F) | 0x80;
+    zigzag >>= 7;
+  }
+  data[length++] = zigzag;
+  return length;
+}
+
+inline void logEncodeArguments(uint8_t* frame __attribute__((unused)), uint8_t& length __attribute__((unused))) {}
+
+template<typename T, typename... Rest>
+inline void logEncodeArguments(uint8_t* frame, uint8_t& length, T value, Rest... rest) {
+  length += logEncodeArgument(frame + length, (int32_t) value);
+  logEncodeArguments(frame, length, rest...);
+}
+
+template<typename... Arguments>
+void logWrite(LogPointId id, Arguments... arguments) {
+  uint8_t frame[LOG_FRAME_HEADER_SIZE + sizeof...(arguments) * LOG_ARGUMENT_MAX_SIZE];
+  uint8_t length = LOG_FRAME_HEADER_SIZE;
+  logEncodeArguments(frame, length, arguments...);
+  frame[0] = LOG_FRAME_START;
+  frame[1] = id;
+  frame[2] = length - LOG_FRAME_HEADER_SIZE;
+  LOG_STREAM.write(frame, length);
+}
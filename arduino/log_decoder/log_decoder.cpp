@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../log_points.h"
+
+// Formats the tokenized log frames read from stdin with the strings in log_points.h. Bytes
+// outside of frames are copied as they are. With -l LEVEL only the points up to LEVEL are shown.
+
+struct LogPointInfo {
+  const char* name;
+  uint8_t level;
+  const char* format;
+};
+
+#define LOG_POINT(name, level, format) {#name, level, format},
+static const LogPointInfo LOG_POINT_INFOS[] = {
+  LOG_POINTS
+};
+#undef LOG_POINT
+static const uint8_t LOG_POINT_COUNT = sizeof(LOG_POINT_INFOS) / sizeof(LOG_POINT_INFOS[0]);
+
+static const char* LEVEL_NAMES[] = {"NONE", "ERROR", "WARNING", "INFO", "DEBUG"};
+static const uint8_t MAX_FRAME_PAYLOAD = 255;
+
+static bool readByte(uint8_t& value) {
+  const int c = getchar();
+  value = c;
+  return c != EOF;
+}
+
+// Returns the number of decoded arguments
+static uint8_t decodeArguments(const uint8_t* data, uint8_t length, int32_t* arguments) {
+  uint8_t count = 0;
+  uint32_t zigzag = 0;
+  uint8_t shift = 0;
+  for (uint8_t i = 0; i < length; ++i) {
+    zigzag |= (uint32_t) (data[i] & 0x7F) << shift;
+    shift += 7;
+    if (!(data[i] & 0x80)) {
+      arguments[count++] = (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+      zigzag = 0;
+      shift = 0;
+    }
+  }
+  return count;
+}
+
+static void printFrame(uint8_t id, const uint8_t* data, uint8_t length) {
+  if (id >= LOG_POINT_COUNT) {
+    printf("Unknown log point %u with %u argument bytes\n", id, length);
+    return;
+  }
+  const LogPointInfo& info = LOG_POINT_INFOS[id];
+  int32_t arguments[MAX_FRAME_PAYLOAD]; // At least 1 byte per argument
+  const uint8_t argumentCount = decodeArguments(data, length, arguments);
+  uint8_t argument = 0;
+
+  printf("%-7s %s: ", LEVEL_NAMES[info.level], info.name);
+  for (const char* c = info.format; *c; ++c) {
+    if (*c != '%' || !c[1]) {
+      putchar(*c);
+      continue;
+    }
+    ++c;
+    if (*c == '%') {
+      putchar('%');
+    } else if (argument == argumentCount) {
+      printf("<missing>");
+    } else if (*c == 'd') {
+      printf("%d", arguments[argument++]);
+    } else if (*c == 'x') {
+      printf("0x%x", (uint32_t) arguments[argument++]);
+    } else {
+      printf("%u", (uint32_t) arguments[argument++]);
+    }
+  }
+  if (argument < argumentCount) {
+    printf(" (%u extra arguments)", argumentCount - argument);
+  }
+  putchar('\n');
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  uint8_t maxLevel = LOG_LEVEL_DEBUG;
+  if (argc > 2 && strcmp(argv[1], "-l") == 0) {
+    maxLevel = atoi(argv[2]);
+  }
+
+  uint8_t value;
+  while (readByte(value)) {
+    if (value != LOG_FRAME_START) {
+      putchar(value);
+      continue;
+    }
+    uint8_t id, length;
+    uint8_t data[MAX_FRAME_PAYLOAD];
+    if (!readByte(id) || !readByte(length) || fread(data, 1, length, stdin) != length) {
+      break;
+    }
+    if (id >= LOG_POINT_COUNT || LOG_POINT_INFOS[id].level <= maxLevel) {
+      printFrame(id, data, length);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Log points of the master and slave firmware, see log.h. The format strings are only compiled
+// into the host decoder (log_decoder/): the firmware sends the position in this list and the
+// arguments. Append new points at the end so that older logs still decode.
+// Format arguments: %d signed, %u unsigned, %x hexadecimal.
+
+const uint8_t LOG_FRAME_START = 0xA5;
+const uint8_t LOG_FRAME_HEADER_SIZE = 3; // Start, log point id, argument bytes
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#define LOG_POINTS \
+  LOG_POINT(SLAVE_BOOT, LOG_LEVEL_INFO, "Boot, address in EEPROM: %u") \
+  LOG_POINT(SLAVE_REQUEST_ADDRESS, LOG_LEVEL_INFO, "Requesting an address from the master") \
+  LOG_POINT(SLAVE_RECEIVED_ADDRESS, LOG_LEVEL_INFO, "Got address %u") \
+  LOG_POINT(SLAVE_NO_ADDRESS, LOG_LEVEL_WARNING, "No address from the master after %u failed requests, retrying") \
+  LOG_POINT(SLAVE_I2C_READY, LOG_LEVEL_INFO, "I2C ready, address %u") \
+  LOG_POINT(SLAVE_ENCODER_PINS, LOG_LEVEL_DEBUG, "Interrupt %u, board %u pins A %u B %u") \
+  LOG_POINT(SLAVE_SWITCH_STATES, LOG_LEVEL_DEBUG, "Switch states %x, changed %x") \
+  LOG_POINT(SLAVE_TOUCH_STATES, LOG_LEVEL_DEBUG, "Touch states %x, changed %x") \
+  LOG_POINT(SLAVE_PAD_STATES, LOG_LEVEL_DEBUG, "Board %u pad states %x, changed %x") \
+  LOG_POINT(SLAVE_PAD_PIN_INPUT, LOG_LEVEL_DEBUG, "Configuring pin %u as input") \
+  LOG_POINT(SLAVE_PAD_PIN_READ, LOG_LEVEL_DEBUG, "Pin %u reads %u") \
+  LOG_POINT(SLAVE_POSITION_CHANGE, LOG_LEVEL_DEBUG, "Position change, board %u, input %u, position %u") \
+  LOG_POINT(SLAVE_ENCODER_CHANGE, LOG_LEVEL_DEBUG, "Encoder change, board %u, input %u, delta %d") \
+  LOG_POINT(MASTER_BOOT, LOG_LEVEL_INFO, "Boot, next address: %u") \
+  LOG_POINT(MASTER_RESTORED_CHANNEL, LOG_LEVEL_INFO, "Restored %u to index %u") \
+  LOG_POINT(MASTER_SENT_ADDRESS, LOG_LEVEL_INFO, "Assigned an address, next address: %u") \
+  LOG_POINT(MASTER_BOARD_CONFIG, LOG_LEVEL_INFO, "Board config for %u, Wire status %u (0 = acknowledged)") \
+  LOG_POINT(MASTER_EVENT_RATE, LOG_LEVEL_INFO, "Events/s: %u") \
+  LOG_POINT(MASTER_RECEIVE_QUEUE, LOG_LEVEL_INFO, "Receive queue high-water mark: %u/%u, dropped frames: %u") \
+  LOG_POINT(MASTER_POLL_STATS, LOG_LEVEL_INFO, "Polls: %u, sync errors: %u, max interval between polls with events (ms): %u") \
+  LOG_POINT(MASTER_RECEIVED_EVENT, LOG_LEVEL_DEBUG, "Received event: address %u, control %u, type %u, value %u") \
+  LOG_POINT(MIDI_CONTROL_CHANGE, LOG_LEVEL_DEBUG, "Sending CC: channel %u, control %u, value %u") \
+  LOG_POINT(MIDI_NOTE_ON, LOG_LEVEL_DEBUG, "Sending NoteOn: channel %u, pitch %u, velocity %u") \
+  LOG_POINT(MIDI_NOTE_OFF, LOG_LEVEL_DEBUG, "Sending NoteOff: channel %u, pitch %u, velocity %u") \
+  LOG_POINT(MASTER_I2C_TIMEOUT, LOG_LEVEL_WARNING, "I2C bus timed out and was reset, %u times since boot") \
+  LOG_POINT(MASTER_EVENT_LATENCY, LOG_LEVEL_DEBUG, "Event from %u, input %u handled %d us after the slave saw it") \
+  LOG_POINT(MASTER_LATENCY_SUMMARY, LOG_LEVEL_INFO, "Latency stage %u (0 slave, 1 receive queue, 2 USB, 3 total): %u events, p50 < %u us, p90 < %u us, p99 < %u us, max %u us") \
+  LOG_POINT(MASTER_LATENCY_BUCKET, LOG_LEVEL_INFO, "Latency stage %u bucket %u (< %u us, the last one unbounded): %u") \
+  LOG_POINT(MASTER_PROFILE_REQUEST, LOG_LEVEL_INFO, "Profile request to %u, Wire status %u (0 = acknowledged)") \
+  LOG_POINT(MASTER_PROFILE, LOG_LEVEL_INFO, "Profile of %u, section %u (see ProfileSection), stat %u (0 calls, 1 min, 2 max, 3 mean cycles): %u")
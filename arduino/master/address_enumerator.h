@@ -0,0 +1,60 @@
+#pragma once
+
+#include "shared.h"
+
+// Master side of the address enumeration (see shared.h). Both handlers run in the Wire
+// interrupts: the request is answered within the same bus transaction.
+class AddressEnumerator
+{
+public:
+  AddressEnumerator() {
+    memset(uniqueIds, 0xFF, sizeof(uniqueIds));
+    memset(response, 0xFF, sizeof(response));
+  }
+
+  // Wire receive interrupt: reads the request from source and assigns the address for the id
+  template<typename Source>
+  void handleRequest(Source& source, volatile uint8_t& nextAddress) {
+    uint8_t request[ADDRESS_REQUEST_SIZE];
+    uint8_t length = 0;
+    while (source.available() && length < ADDRESS_REQUEST_SIZE) {
+      request[length++] = source.read();
+    }
+    if (length != ADDRESS_REQUEST_SIZE) {
+      return;
+    }
+    const uint8_t* uniqueId = request + 1;
+    memcpy(response, uniqueId, UNIQUE_ID_SIZE);
+    response[UNIQUE_ID_SIZE] = assign(uniqueId, nextAddress);
+  }
+
+  // Wire request interrupt: answers the read that follows the request
+  template<typename Destination>
+  void writeResponse(Destination& destination) {
+    destination.write(response, ADDRESS_RESPONSE_SIZE);
+  }
+
+private:
+  uint8_t assign(const uint8_t* uniqueId, volatile uint8_t& nextAddress) {
+    if (nextAddress < FIRST_SLAVE_ADDRESS) {
+      nextAddress = FIRST_SLAVE_ADDRESS;
+    }
+    for (uint8_t address = FIRST_SLAVE_ADDRESS; address < nextAddress && address <= MAX_SLAVE_ADDRESS; ++address) {
+      if (memcmp(uniqueIds[address - FIRST_SLAVE_ADDRESS], uniqueId, UNIQUE_ID_SIZE) == 0) {
+        return address;
+      }
+    }
+    if (nextAddress > MAX_SLAVE_ADDRESS) {
+      return NO_ADDRESS;
+    }
+    const uint8_t address = nextAddress;
+    memcpy(uniqueIds[address - FIRST_SLAVE_ADDRESS], uniqueId, UNIQUE_ID_SIZE);
+    nextAddress = address + 1;
+    return address;
+  }
+
+  // Ids that got an address since the master started, indexed with the address. Erased ids
+  // (0xFF...) never match, the slaves replace them before asking.
+  uint8_t uniqueIds[SLAVE_ADDRESS_COUNT][UNIQUE_ID_SIZE];
+  uint8_t response[ADDRESS_RESPONSE_SIZE];
+};
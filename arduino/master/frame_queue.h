@@ -0,0 +1,85 @@
+#pragma once
+
+#include <util/atomic.h>
+
+#include "shared.h"
+
+// Raw frames received in the Wire interrupt, decoded and dispatched in loop().
+// The interrupt is the only producer and loop() the only consumer.
+const uint8_t FRAME_QUEUE_SIZE = 8; // Power of two
+
+struct FrameQueueStats {
+  uint16_t dropped; // Frames that arrived while the queue was full
+  uint8_t highWaterMark; // Most frames waiting at once
+};
+
+class FrameQueue
+{
+public:
+  // Producer side: copies what is left in the Wire receive buffer
+  template<typename Source>
+  void push(Source& source) {
+    const uint8_t count = head - tail;
+    if (count == FRAME_QUEUE_SIZE) {
+      stats.dropped++;
+      return;
+    }
+    Frame& frame = frames[head & MASK];
+    frame.receivedMicros = micros();
+    frame.length = 0;
+    while (source.available() && frame.length < MESSAGE_FRAME_MAX_SIZE) {
+      frame.data[frame.length++] = source.read();
+    }
+    if (frame.length == 0) {
+      return;
+    }
+    __asm__ __volatile__("" ::: "memory");
+    head++;
+    if (count + 1 > stats.highWaterMark) {
+      stats.highWaterMark = count + 1;
+    }
+  }
+
+  // Consumer side: the frame stays valid until pop(). receivedMicros: micros() in the interrupt.
+  bool peek(const uint8_t*& data, uint8_t& length, uint32_t& receivedMicros) const {
+    if (head == tail) {
+      return false;
+    }
+    __asm__ __volatile__("" ::: "memory");
+    const Frame& frame = frames[tail & MASK];
+    data = frame.data;
+    length = frame.length;
+    receivedMicros = frame.receivedMicros;
+    return true;
+  }
+
+  void pop() {
+    __asm__ __volatile__("" ::: "memory");
+    tail++;
+  }
+
+  FrameQueueStats getStats() const {
+    FrameQueueStats current;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      current.dropped = stats.dropped;
+      current.highWaterMark = stats.highWaterMark;
+    }
+    return current;
+  }
+
+private:
+  static const uint8_t MASK = FRAME_QUEUE_SIZE - 1;
+  static_assert((FRAME_QUEUE_SIZE & MASK) == 0, "FRAME_QUEUE_SIZE must be a power of two");
+
+  struct Frame {
+    uint32_t receivedMicros;
+    uint8_t length;
+    uint8_t data[MESSAGE_FRAME_MAX_SIZE];
+  };
+
+  Frame frames[FRAME_QUEUE_SIZE];
+  // Free-running, the difference is the number of waiting frames
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+  volatile FrameQueueStats stats = {0, 0};
+};
@@ -2,6 +2,12 @@
 #include <EEPROM.h>
 
 #include "shared.h"
+#include "polling.h"
+#include "frame_queue.h"
+#include "address_enumerator.h"
+// Tokenized, decode the output with log_decoder/
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log.h"
 
 //#include <stdarg.h>
 //void p(char *fmt, ... ){
@@ -20,19 +26,41 @@ const uint8_t SS1Pin = 4;
 const byte I2C_RX_LED_PIN = 10;
 const byte I2C_TX_LED_PIN = 9;
 
+FrameQueue receivedFrames;
+uint16_t i2cTimeouts = 0;
+unsigned long lastTimeSyncMillis = 0;
+AddressEnumerator addresses;
+uint8_t persistedNextAddress;
+#ifdef MESSAGE_POLLING_ENABLED
+MessagePoller poller;
+#else
+uint32_t receivedEvents = 0;
+#endif
+// Serial command: SERIAL_COMMAND_BOARD_CONFIG, slave address, config length, board config (see shared.h)
+const uint8_t SERIAL_COMMAND_BOARD_CONFIG = 'C';
+// Serial command: SERIAL_COMMAND_PROFILE, slave address, PROFILE_REQUEST_* flags
+const uint8_t SERIAL_COMMAND_PROFILE = 'P';
+
+unsigned long lastStatsMillis = 0;
+uint32_t lastStatsEvents = 0;
+
 void setup() {
   nextAddress = EEPROM.read(0);
   nextAddress = nextAddress == 255 ? 0 : nextAddress;
 
   Serial.begin(115200);
   Wire.begin(MASTER_ADDRESS); // join i2c bus (address optional for master)
+  Wire.setClock(I2C_CLOCK_HZ);
+#ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout(I2C_TIMEOUT_MICROS, true);
+#endif
   Wire.onRequest(sendAddress);
   Wire.onReceive(handleControlChange);
 
   pinMode(SS1Pin, OUTPUT);
   digitalWrite(SS1Pin, LOW);
-  Serial.print("Next address: ");
-  Serial.println(nextAddress);
+  LOG(MASTER_BOOT, nextAddress);
+  persistedNextAddress = nextAddress;
 
   pinMode(I2C_RX_LED_PIN, OUTPUT);
   digitalWrite(I2C_RX_LED_PIN, HIGH);
@@ -42,8 +70,123 @@ void setup() {
 }
 
 void loop() {
-  delay(100);
-  Serial.print(".");
+#ifdef MESSAGE_POLLING_ENABLED
+  poller.poll(nextAddress, handleMessage);
+#endif
+  dispatchReceivedFrames();
+  handleSerialCommand();
+  persistNextAddress();
+  checkWireTimeout();
+  sendTimeSync();
+  printStats();
+}
+
+void checkWireTimeout() {
+#ifdef WIRE_HAS_TIMEOUT
+  if (Wire.getWireTimeoutFlag()) {
+    Wire.clearWireTimeoutFlag();
+    i2cTimeouts++;
+    LOG(MASTER_I2C_TIMEOUT, i2cTimeouts);
+  }
+#endif
+}
+
+// Lets the slaves stamp their events with this clock, see TIME_SYNC_COMMAND
+void sendTimeSync() {
+  if (millis() - lastTimeSyncMillis < TIME_SYNC_PERIOD_MILLIS) {
+    return;
+  }
+  lastTimeSyncMillis = millis();
+
+  uint8_t sync[TIME_SYNC_SIZE];
+  writeTimeSync(sync, micros());
+  Wire.beginTransmission(GENERAL_CALL_ADDRESS);
+  Wire.write(sync, sizeof(sync));
+  Wire.endTransmission();
+}
+
+// The address requests are answered in the Wire interrupt, the EEPROM is written from here
+void persistNextAddress() {
+  const uint8_t address = nextAddress;
+  if (address == persistedNextAddress) {
+    return;
+  }
+  persistedNextAddress = address;
+  EEPROM.update(0, address);
+  LOG(MASTER_SENT_ADDRESS, address);
+}
+
+void handleSerialCommand() {
+  if (!Serial.available()) {
+    return;
+  }
+  switch (Serial.read()) {
+    case SERIAL_COMMAND_BOARD_CONFIG:
+      handleBoardConfigCommand();
+      break;
+    case SERIAL_COMMAND_PROFILE:
+      handleProfileCommand();
+      break;
+    default:
+      break;
+  }
+}
+
+void handleBoardConfigCommand() {
+  uint8_t header[2];
+  if (Serial.readBytes(header, sizeof(header)) != sizeof(header) || header[1] > BOARD_CONFIG_MAX_SIZE) {
+    return;
+  }
+  uint8_t config[BOARD_CONFIG_MAX_SIZE];
+  if (Serial.readBytes(config, header[1]) != header[1]) {
+    return;
+  }
+
+  // The slave answers with a DEBUG_BOARD_CONFIG message once the config is stored
+  const uint8_t result = writeBoardConfig(header[0], config, header[1]);
+  LOG(MASTER_BOARD_CONFIG, header[0], result);
+}
+
+// The slave answers with its profile over the next update() passes, see handleMessage()
+void handleProfileCommand() {
+  uint8_t request[2];
+  if (Serial.readBytes(request, sizeof(request)) != sizeof(request)) {
+    return;
+  }
+  Wire.beginTransmission(request[0]);
+  Wire.write(PROFILE_REQUEST_COMMAND);
+  Wire.write(request[1]);
+  const uint8_t result = Wire.endTransmission();
+  LOG(MASTER_PROFILE_REQUEST, request[0], result);
+}
+
+uint8_t writeBoardConfig(uint8_t address, const uint8_t* config, uint8_t length) {
+  Wire.beginTransmission(address);
+  Wire.write(BOARD_CONFIG_COMMAND);
+  Wire.write(config, length);
+  return Wire.endTransmission();
+}
+
+void printStats() {
+  if (millis() - lastStatsMillis < 1000) {
+    return;
+  }
+  lastStatsMillis = millis();
+
+#ifdef MESSAGE_POLLING_ENABLED
+  const uint32_t events = poller.stats.events;
+#else
+  const uint32_t events = receivedEvents;
+#endif
+  LOG(MASTER_EVENT_RATE, events - lastStatsEvents);
+  lastStatsEvents = events;
+
+  const FrameQueueStats queueStats = receivedFrames.getStats();
+  LOG(MASTER_RECEIVE_QUEUE, queueStats.highWaterMark, FRAME_QUEUE_SIZE, queueStats.dropped);
+
+#ifdef MESSAGE_POLLING_ENABLED
+  LOG(MASTER_POLL_STATS, poller.stats.polls, poller.stats.syncErrors, poller.stats.maxEventIntervalMillis);
+#endif
 }
 
 inline void togglePin(byte outputPin) {
@@ -58,38 +201,53 @@ inline void toggleTxLed() {
   togglePin(I2C_TX_LED_PIN);
 }
 
+// Runs in the Wire interrupt, answers the address request of the same transaction
 void sendAddress() {
   toggleTxLed();
-  Wire.write(nextAddress);
-  nextAddress++;
-  EEPROM.write(0, nextAddress);
-  Serial.println("Sent address:");
-  Serial.println(nextAddress);
+  addresses.writeResponse(Wire);
 }
 
-SlaveToMasterMessage readMessage() {
-  byte address = Wire.read();
-  byte input = Wire.read();
-  byte type = Wire.read();
-  byte valueHighByte = Wire.read();
-  byte valueLowByte = Wire.read();
-
-  SlaveToMasterMessage message = {address, input, type, word(valueHighByte, valueLowByte)};
+SlaveToMasterMessage readMessage(const uint8_t* data, uint32_t receivedMicros) {
+  SlaveToMasterMessage message = {data[0], data[1], (ControlType) data[2], word(data[3], data[4]), receivedMicros, false};
   return message;
 }
 
-void handleControlChange() {
-  toggleRxLed();
-  Serial.println("Received event:");
+// Runs in the Wire interrupt: only copies the frame, loop() decodes it
+void handleControlChange(int byteCount) {
+  if (Wire.peek() == ADDRESS_REQUEST_COMMAND) {
+    addresses.handleRequest(Wire, nextAddress);
+    return;
+  }
+  receivedFrames.push(Wire);
+}
 
-  SlaveToMasterMessage message = readMessage();
+void dispatchReceivedFrames() {
+  const uint8_t* frame;
+  uint8_t length;
+  uint32_t receivedMicros;
+  while (receivedFrames.peek(frame, length, receivedMicros)) {
+    toggleRxLed();
+    if (isMessageFrame(frame)) {
+#ifdef MESSAGE_POLLING_ENABLED
+      dispatchMessageFrame(frame, length, handleMessage, receivedMicros);
+#else
+      receivedEvents += dispatchMessageFrame(frame, length, handleMessage, receivedMicros);
+#endif
+    } else if (length >= SlaveToMasterMessageSize) {
+      handleMessage(readMessage(frame, receivedMicros));
+    }
+    receivedFrames.pop();
+  }
+}
 
-  Serial.print("Address: ");
-  Serial.print(message.address);
-  Serial.print(", Control: ");
-  Serial.print(message.control);
-  Serial.print(", Type: ");
-  Serial.print(message.type);
-  Serial.print(", Value: ");
-  Serial.println(message.value);
+void handleMessage(const SlaveToMasterMessage& message) {
+  if (message.type == CONTROL_TYPE_DEBUG && message.input >= DEBUG_PROFILE) {
+    const uint8_t profileIndex = message.input - DEBUG_PROFILE;
+    LOG(MASTER_PROFILE, message.address, profileIndex / PROFILE_STAT_COUNT, profileIndex % PROFILE_STAT_COUNT, message.value);
+    return;
+  }
+  if (message.timestamped) {
+    LOG(MASTER_EVENT_LATENCY, message.address, message.input, (int32_t) (micros() - message.time));
+  }
+  LOG(MASTER_RECEIVED_EVENT, message.address, message.input, message.type, message.value);
 }
@@ -0,0 +1 @@
+../address_enumerator.h
\ No newline at end of file
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <EEPROM.h>
+
+#include "shared.h"
+#include "eeprom_log.h"
+
+// Slaves get slots in the order they are first seen. A slave's inputs use all 128 controls and
+// notes of a channel, so only the first 16 slots get a MIDI channel (the slot number). The later
+// slots are kept so that the order stays the same, but their slaves are not mapped to MIDI.
+const uint8_t MIDI_CHANNEL_COUNT = 16;
+const uint8_t I2C_ADDRESS_COUNT = 128;
+const uint8_t MAX_SLOT_COUNT = SLAVE_ADDRESS_COUNT;
+const uint8_t SLOT_NONE = 0xFF;
+
+// Before the log: byte 0 held the next address and bytes 1-15 the addresses of channels 0-14
+const uint8_t LEGACY_CHANNEL_COUNT = 15;
+const uint16_t CHANNEL_LOG_START = 16;
+
+// Log keys: slave addresses (value = slot) and the next address handed out to a slave
+const uint8_t CHANNEL_LOG_KEY_NEXT_ADDRESS = 0x80;
+
+struct MidiTarget {
+  uint8_t channel;
+};
+
+class ChannelRegistry
+{
+public:
+  ChannelRegistry() : log(CHANNEL_LOG_START, EEPROM.length()) {
+    memset((void*) slots, SLOT_NONE, sizeof(slots));
+  }
+
+  void begin() {
+    instance = this;
+    log.begin(replayRecord);
+    persistedSlotCount = slotCount;
+    persistedNextAddress = nextAddress;
+    if (log.isEmpty()) {
+      importLegacyLayout();
+    }
+  }
+
+  // Registers unknown addresses in the next free slot. Does not touch the EEPROM, so it is
+  // safe in the Wire interrupt. Returns false when the slave has no MIDI channel.
+  bool lookup(uint8_t address, MidiTarget& target) {
+    uint8_t slot = slots[address & 0x7F];
+    if (slot == SLOT_NONE) {
+      if (slotCount == MAX_SLOT_COUNT) {
+        return false;
+      }
+      slot = slotCount;
+      slots[address & 0x7F] = slot;
+      slotAddresses[slot] = address & 0x7F;
+      slotCount = slot + 1; // Published last for persist()
+    }
+    if (slot >= MIDI_CHANNEL_COUNT) {
+      return false;
+    }
+    target.channel = slot;
+    return true;
+  }
+
+  uint8_t getSlotCount() const {
+    return slotCount;
+  }
+
+  uint8_t getAddress(uint8_t slot) const {
+    return slotAddresses[slot];
+  }
+
+  // Address handed out to the next slave that asks for one
+  volatile uint8_t nextAddress = 0;
+
+  // Writes what changed since the previous call to the log, call from loop()
+  void persist() {
+    const uint8_t count = slotCount;
+    while (persistedSlotCount < count) {
+      log.append(slotAddresses[persistedSlotCount], persistedSlotCount, isLive);
+      persistedSlotCount++;
+    }
+    const uint8_t address = nextAddress;
+    if (address != persistedNextAddress) {
+      persistedNextAddress = address;
+      log.append(CHANNEL_LOG_KEY_NEXT_ADDRESS, address, isLive);
+    }
+  }
+
+private:
+  static void replayRecord(uint8_t key, uint8_t value) {
+    if (key == CHANNEL_LOG_KEY_NEXT_ADDRESS) {
+      instance->nextAddress = value;
+    } else if (key < I2C_ADDRESS_COUNT && value < MAX_SLOT_COUNT && instance->slots[key] == SLOT_NONE) {
+      instance->slots[key] = value;
+      instance->slotAddresses[value] = key;
+      instance->slotCount = max(instance->slotCount, value + 1);
+    }
+  }
+
+  static bool isLive(uint8_t key, uint8_t value) {
+    if (key == CHANNEL_LOG_KEY_NEXT_ADDRESS) {
+      return value == instance->persistedNextAddress;
+    }
+    return key < I2C_ADDRESS_COUNT && instance->slots[key] == value;
+  }
+
+  void importLegacyLayout() {
+    const uint8_t address = EEPROM.read(0);
+    nextAddress = address == 255 ? 0 : address;
+    for (uint8_t i = 0; i < LEGACY_CHANNEL_COUNT; ++i) {
+      const uint8_t slaveAddress = EEPROM.read(i + 1);
+      if (slaveAddress == 255) {
+        break;
+      }
+      MidiTarget target;
+      lookup(slaveAddress, target);
+    }
+    // Stored in the log by the first persist()
+    persistedNextAddress = ~nextAddress;
+  }
+
+  static ChannelRegistry* instance;
+
+  EepromLog log;
+  volatile uint8_t slots[I2C_ADDRESS_COUNT]; // Indexed with the 7-bit address
+  volatile uint8_t slotAddresses[MAX_SLOT_COUNT];
+  volatile uint8_t slotCount = 0;
+  uint8_t persistedSlotCount = 0;
+  uint8_t persistedNextAddress = 0;
+};
+
+ChannelRegistry* ChannelRegistry::instance = 0;
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <EEPROM.h>
+
+// Journal of 2 byte [key][value] records in a ring of EEPROM records. A changed value is
+// appended after the newest record instead of rewritten in place, which spreads the writes over
+// the whole ring. One erased record (the gap) separates the newest record from the oldest one.
+// When the ring is full, the oldest records that are still live are copied to the newest end
+// before their place is reused. Each append takes ~3.3 ms per written byte: call it from loop().
+const uint8_t EEPROM_LOG_ERASED = 0xFF;
+
+typedef bool (*EepromLogLiveness)(uint8_t key, uint8_t value);
+typedef void (*EepromLogReplay)(uint8_t key, uint8_t value);
+
+class EepromLog
+{
+public:
+  EepromLog(uint16_t start, uint16_t end) : start(start), recordCount((end - start) / RECORD_SIZE) {}
+
+  // Passes the records to replay from the oldest to the newest
+  void begin(EepromLogReplay replay) {
+    gap = 0;
+    for (uint16_t i = 0; i < recordCount; ++i) {
+      if (isErased(i) && !isErased(previous(i))) {
+        gap = i;
+        break;
+      }
+    }
+    empty = true;
+    for (uint16_t i = next(gap); i != gap; i = next(i)) {
+      if (!isErased(i)) {
+        empty = false;
+        replay(readKey(i), readValue(i));
+      }
+    }
+  }
+
+  bool isEmpty() const {
+    return empty;
+  }
+
+  // isLive tells whether an old record still holds the current value of its key
+  void append(uint8_t key, uint8_t value, EepromLogLiveness isLive) {
+    uint16_t oldest = next(gap);
+    while (!isErased(oldest) && isLive(readKey(oldest), readValue(oldest))) {
+      // Written before the old copy is erased so that a reset in between keeps the record
+      write(gap, readKey(oldest), readValue(oldest));
+      EEPROM.update(address(oldest), EEPROM_LOG_ERASED);
+      gap = oldest;
+      oldest = next(gap);
+    }
+    // Erase first: a reset in between loses only the new record
+    EEPROM.update(address(oldest), EEPROM_LOG_ERASED);
+    write(gap, key, value);
+    gap = oldest;
+    empty = false;
+  }
+
+private:
+  static const uint8_t RECORD_SIZE = 2;
+
+  uint16_t address(uint16_t record) const {
+    return start + record * RECORD_SIZE;
+  }
+
+  uint16_t next(uint16_t record) const {
+    return record + 1 == recordCount ? 0 : record + 1;
+  }
+
+  uint16_t previous(uint16_t record) const {
+    return record == 0 ? recordCount - 1 : record - 1;
+  }
+
+  bool isErased(uint16_t record) const {
+    return readKey(record) == EEPROM_LOG_ERASED;
+  }
+
+  uint8_t readKey(uint16_t record) const {
+    return EEPROM.read(address(record));
+  }
+
+  uint8_t readValue(uint16_t record) const {
+    return EEPROM.read(address(record) + 1);
+  }
+
+  // The key goes last, it makes the record visible
+  void write(uint16_t record, uint8_t key, uint8_t value) {
+    EEPROM.update(address(record) + 1, value);
+    EEPROM.update(address(record), key);
+  }
+
+  const uint16_t start;
+  const uint16_t recordCount;
+  uint16_t gap = 0;
+  bool empty = true;
+};
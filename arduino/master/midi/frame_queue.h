@@ -0,0 +1 @@
+../frame_queue.h
\ No newline at end of file
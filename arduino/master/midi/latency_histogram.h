@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Where a control change spends its time between the pin edge on the slave and the USB transfer
+// of its MIDI event. The edge time comes from the event timestamps (see TIME_SYNC_COMMAND), frames
+// without them (before the first time sync of their slave) count only in the other stages.
+enum LatencyStage : uint8_t {
+  LATENCY_STAGE_SLAVE, // Pin edge to the master's Wire receive interrupt: slave loop, outbox and bus
+  LATENCY_STAGE_RECEIVE_QUEUE, // Wire receive interrupt to handleMessage() in loop()
+  LATENCY_STAGE_USB, // handleMessage() to the USB transfer of the MIDI event
+  LATENCY_STAGE_TOTAL, // Pin edge to the USB transfer
+  LATENCY_STAGE_COUNT
+};
+
+// Bucket 0 counts latencies below 1 us (clock offsets can make them negative), bucket i
+// the ones below 2^i us and the last one everything from 2^(LATENCY_BUCKET_COUNT - 2) us.
+const uint8_t LATENCY_BUCKET_COUNT = 22;
+
+struct LatencySummary {
+  uint32_t count;
+  uint32_t maxMicros;
+  // Upper bounds of the buckets that hold the percentiles
+  uint32_t p50Micros;
+  uint32_t p90Micros;
+  uint32_t p99Micros;
+};
+
+class LatencyHistogram
+{
+public:
+  LatencyHistogram() {
+    reset();
+  }
+
+  void record(LatencyStage stage, int32_t latencyMicros) {
+    const uint32_t latency = latencyMicros > 0 ? latencyMicros : 0;
+    uint8_t bucket = 0;
+    while (bucket < LATENCY_BUCKET_COUNT - 1 && latency >= bucketLimitMicros(bucket)) {
+      bucket++;
+    }
+    if (counts[stage][bucket] != UINT16_MAX) {
+      counts[stage][bucket]++;
+    }
+    totals[stage]++;
+    if (latency > maxMicros[stage]) {
+      maxMicros[stage] = latency;
+    }
+  }
+
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    memset(totals, 0, sizeof(totals));
+    memset(maxMicros, 0, sizeof(maxMicros));
+  }
+
+  uint16_t count(LatencyStage stage, uint8_t bucket) const {
+    return counts[stage][bucket];
+  }
+
+  // Latencies in bucket are below this, the last bucket has no limit
+  static uint32_t bucketLimitMicros(uint8_t bucket) {
+    return (uint32_t) 1 << bucket;
+  }
+
+  LatencySummary summarize(LatencyStage stage) const {
+    LatencySummary summary = {totals[stage], maxMicros[stage], 0, 0, 0};
+    // Saturated buckets count less than totals, the percentiles only use the buckets
+    uint32_t bucketTotal = 0;
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+      bucketTotal += counts[stage][bucket];
+    }
+    uint32_t counted = 0;
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKET_COUNT && bucketTotal; ++bucket) {
+      counted += counts[stage][bucket];
+      // The last bucket is only bounded by the maximum
+      const uint32_t limit = bucket < LATENCY_BUCKET_COUNT - 1 ? bucketLimitMicros(bucket) : summary.maxMicros;
+      if (summary.p50Micros == 0 && counted * 100 >= bucketTotal * 50) {
+        summary.p50Micros = limit;
+      }
+      if (summary.p90Micros == 0 && counted * 100 >= bucketTotal * 90) {
+        summary.p90Micros = limit;
+      }
+      if (summary.p99Micros == 0 && counted * 100 >= bucketTotal * 99) {
+        summary.p99Micros = limit;
+      }
+    }
+    return summary;
+  }
+
+private:
+  uint16_t counts[LATENCY_STAGE_COUNT][LATENCY_BUCKET_COUNT]; // Saturate at UINT16_MAX
+  uint32_t totals[LATENCY_STAGE_COUNT];
+  uint32_t maxMicros[LATENCY_STAGE_COUNT];
+};
@@ -0,0 +1 @@
+../../log.h
\ No newline at end of file
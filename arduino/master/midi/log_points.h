@@ -0,0 +1 @@
+../../log_points.h
\ No newline at end of file
@@ -1,49 +1,61 @@
 #include <MIDIUSB.h>
 #include <Wire.h>
 #include <EEPROM.h>
-#include <limits.h>
 
 #include "shared.h"
-
-volatile byte nextAddress;
-volatile byte nextAddressIndex = 0;
-
-const byte CHANNEL_COUNT = 15;
-const byte ADDRESS_NOT_FOUND = CHAR_MAX;
-volatile byte addressToMidiChannels[CHANNEL_COUNT];
+#include "polling.h"
+#include "frame_queue.h"
+#include "address_enumerator.h"
+#include "channel_registry.h"
+#include "midi_queue.h"
+#include "latency_histogram.h"
+// Tokenized, decode the output with log_decoder/. The per event points are compiled out.
+#define LOG_LEVEL LOG_LEVEL_INFO
+#include "log.h"
+
+ChannelRegistry channels;
 
 const uint8_t SS1Pin = 4;
 
 const byte I2C_RX_LED_PIN = 10;
 const byte I2C_TX_LED_PIN = 9;
 
+FrameQueue receivedFrames;
+uint16_t i2cTimeouts = 0;
+unsigned long lastTimeSyncMillis = 0;
+AddressEnumerator addresses;
+uint8_t loggedNextAddress;
+LatencyHistogram latency;
+MidiQueue sentEvents(latency);
+// Wire receive interrupt time of the frame that handleMessage() is called for
+uint32_t receivedFrameMicros = 0;
+// Serial commands, answered with log frames
+const uint8_t SERIAL_COMMAND_LATENCY = 'L';
+const uint8_t SERIAL_COMMAND_LATENCY_RESET = 'R';
+FrameQueueStats reportedQueueStats = {0, 0};
+#ifdef MESSAGE_POLLING_ENABLED
+MessagePoller poller;
+#endif
+
 void setup() {
-  nextAddress = EEPROM.read(0);
-  nextAddress = nextAddress == 255 ? 0 : nextAddress;
+  channels.begin();
 
   Serial.begin(115200);
   Wire.begin(MASTER_ADDRESS); // join i2c bus (address optional for master)
-
-  for (byte i = 0; i < CHANNEL_COUNT; ++i) {
-    byte address = EEPROM.read(i+1);
-    if (address == 255) break;
-
-    addressToMidiChannels[i] = address;
-    nextAddressIndex++;
-  }
+  Wire.setClock(I2C_CLOCK_HZ);
+#ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout(I2C_TIMEOUT_MICROS, true);
+#endif
 
   Wire.onRequest(sendAddress);
   Wire.onReceive(handleControlChange);
 
-  Serial.begin(115200);
-
-  Serial.println("Boot");
+  LOG(MASTER_BOOT, channels.nextAddress);
+  loggedNextAddress = channels.nextAddress;
   printChannels();
 
   pinMode(SS1Pin, OUTPUT);
   digitalWrite(SS1Pin, LOW);
-  Serial.print("Next address: ");
-  Serial.println(nextAddress);
 
   pinMode(I2C_RX_LED_PIN, OUTPUT);
   digitalWrite(I2C_RX_LED_PIN, HIGH);
@@ -53,16 +65,91 @@ void setup() {
 }
 
 void loop() {
-  delay(100);
-  Serial.print(".");
+#ifdef MESSAGE_POLLING_ENABLED
+  poller.poll(channels.nextAddress, handleMessage);
+#endif
+  dispatchReceivedFrames();
+  sentEvents.update();
+  printQueueStats();
+  // The interrupt handlers only update the registry in RAM
+  channels.persist();
+  logAssignedAddresses();
+  checkWireTimeout();
+  sendTimeSync();
+  handleSerialCommand();
+}
+
+void checkWireTimeout() {
+#ifdef WIRE_HAS_TIMEOUT
+  if (Wire.getWireTimeoutFlag()) {
+    Wire.clearWireTimeoutFlag();
+    i2cTimeouts++;
+    LOG(MASTER_I2C_TIMEOUT, i2cTimeouts);
+  }
+#endif
+}
+
+// Lets the slaves stamp their events with this clock, see TIME_SYNC_COMMAND
+void sendTimeSync() {
+  if (millis() - lastTimeSyncMillis < TIME_SYNC_PERIOD_MILLIS) {
+    return;
+  }
+  lastTimeSyncMillis = millis();
+
+  uint8_t sync[TIME_SYNC_SIZE];
+  writeTimeSync(sync, micros());
+  Wire.beginTransmission(GENERAL_CALL_ADDRESS);
+  Wire.write(sync, sizeof(sync));
+  Wire.endTransmission();
+}
+
+void logAssignedAddresses() {
+  const uint8_t address = channels.nextAddress;
+  if (address != loggedNextAddress) {
+    loggedNextAddress = address;
+    LOG(MASTER_SENT_ADDRESS, address);
+  }
+}
+
+void handleSerialCommand() {
+  if (!Serial.available()) {
+    return;
+  }
+  switch (Serial.read()) {
+    case SERIAL_COMMAND_LATENCY:
+      printLatency();
+      break;
+    case SERIAL_COMMAND_LATENCY_RESET:
+      latency.reset();
+      break;
+  }
+}
+
+void printLatency() {
+  for (uint8_t stage = 0; stage < LATENCY_STAGE_COUNT; ++stage) {
+    const LatencySummary summary = latency.summarize((LatencyStage) stage);
+    LOG(MASTER_LATENCY_SUMMARY, stage, summary.count, summary.p50Micros, summary.p90Micros, summary.p99Micros, summary.maxMicros);
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+      const uint16_t count = latency.count((LatencyStage) stage, bucket);
+      if (count) {
+        LOG(MASTER_LATENCY_BUCKET, stage, bucket, LatencyHistogram::bucketLimitMicros(bucket), count);
+      }
+    }
+  }
+}
+
+void printQueueStats() {
+  const FrameQueueStats stats = receivedFrames.getStats();
+  if (stats.dropped == reportedQueueStats.dropped && stats.highWaterMark == reportedQueueStats.highWaterMark) {
+    return;
+  }
+  reportedQueueStats = stats;
+  LOG(MASTER_RECEIVE_QUEUE, stats.highWaterMark, FRAME_QUEUE_SIZE, stats.dropped);
 }
 
 void printChannels() {
-  for (byte i = 0; i < CHANNEL_COUNT; ++i) {
-    Serial.print("Restored ");
-    Serial.print(addressToMidiChannels[i]);
-    Serial.print(" to index ");
-    Serial.println(i);
+  for (byte i = 0; i < channels.getSlotCount(); ++i) {
+    LOG(MASTER_RESTORED_CHANNEL, channels.getAddress(i), i);
   }
 }
 
@@ -78,125 +165,102 @@ inline void toggleTxLed() {
   togglePin(I2C_TX_LED_PIN);
 }
 
+// Runs in the Wire interrupt, answers the address request of the same transaction
 void sendAddress() {
   toggleTxLed();
-  Wire.write(nextAddress);
-  nextAddress++;
-  EEPROM.write(0, nextAddress);
-  Serial.println("Sent address:");
-  Serial.println(nextAddress);
+  addresses.writeResponse(Wire);
 }
 
-SlaveToMasterMessage readMessage() {
-  byte address = Wire.read();
-  byte input = Wire.read();
-  byte type = Wire.read();
-  byte valueHighByte = Wire.read();
-  byte valueLowByte = Wire.read();
-
-  SlaveToMasterMessage message = {address, input, type, word(valueHighByte, valueLowByte)};
+SlaveToMasterMessage readMessage(const uint8_t* data, uint32_t receivedMicros) {
+  SlaveToMasterMessage message = {data[0], data[1], (ControlType) data[2], word(data[3], data[4]), receivedMicros, false};
   return message;
 }
 
-byte findChannelForAddress(byte address) {
-  for (byte i = 0; i < CHANNEL_COUNT; ++i) {
-    if (addressToMidiChannels[i] == address) return i;
+// Runs in the Wire interrupt: only copies the frame, loop() decodes it
+void handleControlChange(int byteCount) {
+  if (Wire.peek() == ADDRESS_REQUEST_COMMAND) {
+    addresses.handleRequest(Wire, channels.nextAddress);
+    return;
   }
-
-  return ADDRESS_NOT_FOUND;
+  receivedFrames.push(Wire);
 }
 
-void saveAddressAsNextChannel(byte address) {
-  Serial.print("Storing ");
-  Serial.print(address);
-  Serial.print(" to index ");
-  Serial.println(nextAddressIndex);
-
-  addressToMidiChannels[nextAddressIndex] = address;
-  EEPROM.write(nextAddressIndex+1, address);
-  nextAddressIndex++;
+void dispatchReceivedFrames() {
+  const uint8_t* frame;
+  uint8_t length;
+  while (receivedFrames.peek(frame, length, receivedFrameMicros)) {
+    toggleRxLed();
+    if (isMessageFrame(frame)) {
+      dispatchMessageFrame(frame, length, handleMessage, receivedFrameMicros);
+    } else if (length >= SlaveToMasterMessageSize) {
+      handleMessage(readMessage(frame, receivedFrameMicros));
+    }
+    receivedFrames.pop();
+  }
 }
 
-void handleControlChange() {
-  toggleRxLed();
-  Serial.println("Received event:");
-
-  SlaveToMasterMessage message = readMessage();
+void handleMessage(const SlaveToMasterMessage& message) {
   const uint16_t value = message.value;
   const ControlType type = message.type;
   const uint8_t input = message.input;
   const uint8_t address = message.address;
 
-  Serial.print("Address: ");
-  Serial.print(address);
-  Serial.print(", Control: ");
-  Serial.print(input);
-  Serial.print(", Type: ");
-  Serial.print(type);
-  Serial.print(", Value: ");
-  Serial.println(value);
+  const uint32_t now = micros();
+#ifdef MESSAGE_POLLING_ENABLED
+  // Polled frames are handled as soon as they are received
+  receivedFrameMicros = now;
+#endif
+  // Without timestamps (the slave has no time sync yet) the event time is the receive time
+  if (message.timestamped) {
+    latency.record(LATENCY_STAGE_SLAVE, receivedFrameMicros - message.time);
+    LOG(MASTER_EVENT_LATENCY, message.address, message.input, (int32_t) (now - message.time));
+  }
+  latency.record(LATENCY_STAGE_RECEIVE_QUEUE, now - receivedFrameMicros);
+  LOG(MASTER_RECEIVED_EVENT, address, input, type, value);
 
-  if (type == CONTROL_TYPE_DEBUG && value == DEBUG_BOOT) {
-    saveAddressAsNextChannel(address); // TODO: slaves do not send their address at boot :facepalm:
+  // Debug messages and the like do not take a channel, inputs past the MIDI range are dropped
+  if ((type != CONTROL_TYPE_POSITION && type != CONTROL_TYPE_ENCODER && type != CONTROL_TYPE_BUTTON) || input > 0x7F) {
+    return;
   }
+  // Registers the slaves in the order they are first heard from
+  MidiTarget target;
+  if (!channels.lookup(address, target)) {
+    return;
+  }
+  const byte control = input;
   if (type == CONTROL_TYPE_POSITION) {
-    byte channel = findChannelForAddress(address);
-    if (channel == ADDRESS_NOT_FOUND) {
-      channel = nextAddressIndex;
-      saveAddressAsNextChannel(address);
-    }
-    controlChange(channel, control, value == 1 ? 1 : 127);
+    controlChange(target.channel, control, value == 1 ? 1 : 127, message.time, message.timestamped);
+  }
+  if (type == CONTROL_TYPE_ENCODER) {
+    // Relative CC in two's complement like the positions above: 1 is one detent up, 127 one down
+    controlChange(target.channel, control, (int8_t) value & 0x7F, message.time, message.timestamped);
   }
   if (type == CONTROL_TYPE_BUTTON) {
-    byte channel = findChannelForAddress(address);
-    if (channel == ADDRESS_NOT_FOUND) {
-      channel = nextAddressIndex;
-      saveAddressAsNextChannel(address);
-    }
-
     if (value == 1) {
-      noteOn(channel, control, 127);
+      noteOn(target.channel, control, 127, message.time, message.timestamped);
     } else {
-      noteOff(channel, control, 0);
+      noteOff(target.channel, control, 0, message.time, message.timestamped);
     }
   }
 }
 
-void controlChange(byte channel, byte control, byte value) {
-  Serial.print("Sending CC: channel: ");
-  Serial.print(channel);
-  Serial.print(", control: ");
-  Serial.print(control);
-  Serial.print(", value: ");
-  Serial.println(value);
+void controlChange(byte channel, byte control, byte value, uint32_t eventMicros, bool timestamped) {
+  LOG(MIDI_CONTROL_CHANGE, channel, control, value);
 
   midiEventPacket_t event = {0x0B, 0xB0 | channel, control, value};
-  MidiUSB.sendMIDI(event);
-  MidiUSB.flush();
+  sentEvents.send(event, eventMicros, timestamped);
 }
 
-void noteOn(byte channel, byte pitch, byte velocity) {
-  Serial.print("Sending NoteOn: channel: ");
-  Serial.print(channel);
-  Serial.print(", pitch: ");
-  Serial.print(pitch);
-  Serial.print(", velocity: ");
-  Serial.println(velocity);
+void noteOn(byte channel, byte pitch, byte velocity, uint32_t eventMicros, bool timestamped) {
+  LOG(MIDI_NOTE_ON, channel, pitch, velocity);
 
   midiEventPacket_t noteOn = {0x09, 0x90 | channel, pitch, velocity};
-  MidiUSB.sendMIDI(noteOn);
-  MidiUSB.flush();
+  sentEvents.send(noteOn, eventMicros, timestamped);
 }
 
-void noteOff(byte channel, byte pitch, byte velocity) {
-  Serial.print("Sending NoteOff: channel: ");
-  Serial.print(channel);
-  Serial.print(", pitch: ");
-  Serial.print(pitch);
-  Serial.print(", velocity: ");
-  Serial.println(velocity);
+void noteOff(byte channel, byte pitch, byte velocity, uint32_t eventMicros, bool timestamped) {
+  LOG(MIDI_NOTE_OFF, channel, pitch, velocity);
 
   midiEventPacket_t noteOff = {0x08, 0x80 | channel, pitch, velocity};
-  MidiUSB.sendMIDI(noteOff);
-  MidiUSB.flush();
+  sentEvents.send(noteOff, eventMicros, timestamped);
 }
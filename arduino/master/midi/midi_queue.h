@@ -0,0 +1,71 @@
+#pragma once
+
+#include <MIDIUSB.h>
+
+#include "latency_histogram.h"
+
+// Outgoing MIDI events are collected and sent as one bulk transfer of up to 64 bytes
+// (16 events) once per 1 ms USB frame or when the packet is full, instead of one transfer per
+// event. MidiUSB.write() is a plain USB_Send() on the MIDI IN endpoint, whose number is private
+// to the MIDIUSB module. The USB and total latency stages are recorded when an event goes out,
+// the total only for events with a slave timestamp.
+const uint8_t MIDI_USB_PACKET_SIZE = 64;
+const uint8_t MIDI_QUEUE_SIZE = MIDI_USB_PACKET_SIZE / sizeof(midiEventPacket_t);
+const uint16_t USB_FRAME_MICROS = 1000;
+
+class MidiQueue
+{
+public:
+  MidiQueue(LatencyHistogram& latency) : latency(latency) {}
+
+  // eventMicros: when the slave saw the event that this MIDI event is for, only known when timestamped
+  void send(const midiEventPacket_t& event, uint32_t eventMicros, bool timestamped) {
+    const uint32_t now = micros();
+    if (count == 0) {
+      firstEventMicros = now;
+    }
+    eventTimes[count].eventMicros = eventMicros;
+    eventTimes[count].sentMicros = now;
+    eventTimes[count].timestamped = timestamped;
+    events[count++] = event;
+    if (count == MIDI_QUEUE_SIZE) {
+      flush();
+    }
+  }
+
+  // Call from loop(): sends the events that have waited for a USB frame
+  void update() {
+    if (count && micros() - firstEventMicros >= USB_FRAME_MICROS) {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (count == 0) {
+      return;
+    }
+    MidiUSB.write((const uint8_t*) events, count * sizeof(midiEventPacket_t));
+    MidiUSB.flush();
+    const uint32_t now = micros();
+    for (uint8_t i = 0; i < count; ++i) {
+      latency.record(LATENCY_STAGE_USB, now - eventTimes[i].sentMicros);
+      if (eventTimes[i].timestamped) {
+        latency.record(LATENCY_STAGE_TOTAL, now - eventTimes[i].eventMicros);
+      }
+    }
+    count = 0;
+  }
+
+private:
+  struct EventTimes {
+    uint32_t eventMicros;
+    uint32_t sentMicros; // send() call, i.e. handleMessage()
+    bool timestamped;
+  };
+
+  LatencyHistogram& latency;
+  midiEventPacket_t events[MIDI_QUEUE_SIZE];
+  EventTimes eventTimes[MIDI_QUEUE_SIZE];
+  uint8_t count = 0;
+  uint32_t firstEventMicros = 0;
+};
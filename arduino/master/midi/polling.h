@@ -0,0 +1 @@
+../polling.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../shared.h
\ No newline at end of file
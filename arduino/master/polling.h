@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Wire.h>
+
+#include "shared.h"
+
+#ifdef MESSAGE_POLLING_ENABLED
+
+// A board that returned events is polled on every pass. Each empty poll doubles its
+// interval up to 2^MAX_POLL_INTERVAL_SHIFT passes.
+const uint8_t MAX_POLL_INTERVAL_SHIFT = 4;
+
+struct PollStats {
+  uint32_t events;
+  uint32_t polls;
+  uint16_t syncErrors; // Invalid lengths and failed frame reads, the slave sends those frames again
+  uint16_t maxEventIntervalMillis; // Longest time between two polls of a board that had events
+};
+
+class MessagePoller
+{
+public:
+  // Runs one polling pass over the addresses below endAddress
+  void poll(uint8_t endAddress, MessageHandler handler) {
+    const uint8_t addressCount = endAddress > FIRST_SLAVE_ADDRESS ? min(endAddress - FIRST_SLAVE_ADDRESS, SLAVE_ADDRESS_COUNT) : 0;
+    for (uint8_t i = 0; i < addressCount; ++i) {
+      if (skippedPasses[i] > 0) {
+        skippedPasses[i]--;
+        continue;
+      }
+
+      const uint16_t now = millis();
+      const uint8_t events = pollSlave(i, handler);
+      if (events) {
+        stats.maxEventIntervalMillis = max(stats.maxEventIntervalMillis, (uint16_t) (now - lastPollMillis[i]));
+        intervalShifts[i] = 0;
+      } else if (intervalShifts[i] < MAX_POLL_INTERVAL_SHIFT) {
+        intervalShifts[i]++;
+      }
+      lastPollMillis[i] = now;
+      skippedPasses[i] = (1 << intervalShifts[i]) - 1;
+    }
+  }
+
+  PollStats stats = {0, 0, 0, 0};
+
+private:
+  uint8_t pollSlave(uint8_t index, MessageHandler handler) {
+    const uint8_t address = FIRST_SLAVE_ADDRESS + index;
+    stats.polls++;
+    // No new frame is read before the last one is acknowledged, so an acknowledgement that
+    // did not get through can not make the slave send a frame twice
+    if (pendingAcks[index] != 0) {
+      if (!acknowledgeFrame(address, pendingAcks[index])) {
+        return 0;
+      }
+      pendingAcks[index] = 0;
+    }
+
+    if (Wire.requestFrom(address, POLL_LENGTH_SIZE, POLL_LENGTH_COMMAND, 1, true) != POLL_LENGTH_SIZE) {
+      return 0;
+    }
+    const uint8_t lengthByte = Wire.read();
+    const uint8_t length = lengthByte & POLL_LENGTH_MASK;
+    if (lengthByte == 0) {
+      return 0;
+    }
+    if (lengthByte & MESSAGE_FRAME_VERSION_MASK || length == 0 || length > MESSAGE_FRAME_MAX_SIZE) {
+      stats.syncErrors++;
+      return 0;
+    }
+
+    uint8_t frame[MESSAGE_FRAME_MAX_SIZE];
+    if (Wire.requestFrom(address, length, POLL_FRAME_COMMAND, 1, true) != length) {
+      stats.syncErrors++;
+      return 0;
+    }
+    for (uint8_t i = 0; i < length; ++i) {
+      frame[i] = Wire.read();
+    }
+    if (!acknowledgeFrame(address, lengthByte)) {
+      pendingAcks[index] = lengthByte;
+    }
+
+    const uint8_t events = dispatchMessageFrame(frame, length, handler, micros());
+    stats.events += events;
+    return events;
+  }
+
+  bool acknowledgeFrame(uint8_t address, uint8_t lengthByte) {
+    Wire.beginTransmission(address);
+    Wire.write(POLL_ACK_COMMAND);
+    Wire.write(lengthByte);
+    return Wire.endTransmission() == 0;
+  }
+
+  uint8_t pendingAcks[SLAVE_ADDRESS_COUNT] = {0}; // Length byte of a frame that was read but not acknowledged
+  uint8_t intervalShifts[SLAVE_ADDRESS_COUNT] = {0};
+  uint8_t skippedPasses[SLAVE_ADDRESS_COUNT] = {0};
+  uint16_t lastPollMillis[SLAVE_ADDRESS_COUNT] = {0};
+};
+
+#endif
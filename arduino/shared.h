@@ -1,5 +1,9 @@
 #pragma once
 
+// Master polls the slaves for their events instead of the slaves writing them to the master.
+// Has to be set the same way for the master and the slave firmware.
+//#define MESSAGE_POLLING_ENABLED
+
 enum ControlType {
   CONTROL_TYPE_DEBUG,
   CONTROL_TYPE_ENCODER,
@@ -11,7 +15,15 @@ enum ControlType {
 
 enum DebugMessage {
   DEBUG_BOOT,
-  DEBUG_RECEIVED_ADDRESS
+  DEBUG_RECEIVED_ADDRESS,
+  DEBUG_INPUT_EVENTS_DROPPED,
+  DEBUG_MESSAGES_DROPPED,
+  DEBUG_LED_FRAMES_DEFERRED,
+  DEBUG_LED_FRAMES_MERGED,
+  DEBUG_BUTTON_GLITCHES,
+  DEBUG_BOARD_CONFIG, // Value is the applied BOARD_CONFIG_VERSION, 0 if the config was rejected
+  DEBUG_I2C_ERRORS, // Value is the count of bus timeouts and bus errors since boot
+  DEBUG_PROFILE // First of the profiler answers, see PROFILE_REQUEST_COMMAND
 };
 
 const uint8_t SlaveToMasterMessageSize = 5;
@@ -20,7 +32,345 @@ struct SlaveToMasterMessage {
   uint8_t input;
   ControlType type;
   uint16_t value;
+  // The master's micros() when the slave saw the event, the time the frame was handled when
+  // the frame has no timestamps (timestamped false). Not part of the encoding.
+  uint32_t time;
+  bool timestamped;
 };
 
+// Compact event encoding: [type (3 bits) | input (5 bits)] followed by the value.
+// Inputs >= MESSAGE_INPUT_ESCAPE are sent in an extra byte after the first one.
+// Values in -127..127 (as int16_t, i.e. small positions, button states and encoder deltas)
+// take one signed byte, anything else is sent as MESSAGE_VALUE_ESCAPE and two bytes.
+const uint8_t MESSAGE_TYPE_SHIFT = 5;
+const uint8_t MESSAGE_INPUT_ESCAPE = 0x1F;
+const uint8_t MESSAGE_VALUE_ESCAPE = 0x80;
+const uint8_t MESSAGE_MAX_ENCODED_SIZE = 5;
+
+// Returns the number of bytes written to data (at most MESSAGE_MAX_ENCODED_SIZE)
+inline uint8_t encodeMessage(uint8_t* data, const SlaveToMasterMessage& message) {
+  uint8_t length = 0;
+  if (message.input < MESSAGE_INPUT_ESCAPE) {
+    data[length++] = ((uint8_t) message.type << MESSAGE_TYPE_SHIFT) | message.input;
+  } else {
+    data[length++] = ((uint8_t) message.type << MESSAGE_TYPE_SHIFT) | MESSAGE_INPUT_ESCAPE;
+    data[length++] = message.input;
+  }
+
+  const int16_t value = (int16_t) message.value;
+  if (value > -128 && value < 128) {
+    data[length++] = (uint8_t) value;
+  } else {
+    data[length++] = MESSAGE_VALUE_ESCAPE;
+    data[length++] = message.value >> 8;
+    data[length++] = message.value & 0xFF;
+  }
+  return length;
+}
+
+// Returns the number of bytes read from data or 0 if the message is truncated.
+// The address is not part of the encoded message.
+inline uint8_t decodeMessage(const uint8_t* data, uint8_t length, SlaveToMasterMessage& message) {
+  uint8_t offset = 0;
+  if (length < 2) {
+    return 0;
+  }
+
+  message.type = (ControlType) (data[offset] >> MESSAGE_TYPE_SHIFT);
+  message.input = data[offset++] & MESSAGE_INPUT_ESCAPE;
+  if (message.input == MESSAGE_INPUT_ESCAPE) {
+    message.input = data[offset++];
+  }
+
+  if (offset >= length) {
+    return 0;
+  }
+  if (data[offset] != MESSAGE_VALUE_ESCAPE) {
+    message.value = (uint16_t) (int16_t) (int8_t) data[offset++];
+  } else {
+    if (offset + 3 > length) {
+      return 0;
+    }
+    message.value = (data[offset + 1] << 8) | data[offset + 2];
+    offset += 3;
+  }
+  return offset;
+}
+
+// v2 frame: [MESSAGE_FRAME_VERSION_2 | event count][address][encoded message]...
+// v1 messages start with the slave address which never has the top bit set.
+// Timestamped v2 frame, sent once the slave got a time sync (see TIME_SYNC_COMMAND):
+// [MESSAGE_FRAME_VERSION_2 | MESSAGE_FRAME_TIMESTAMPED | event count][address][frame time]([encoded message][age])...
+// Frame time: the master's micros() >> MESSAGE_TIME_SHIFT when the frame was written, low 16 bits
+// big endian (wraps after about 1 s). Age: how long the event waited in the slave before that,
+// in the same units. 0..127 take one byte, longer ages two bytes with the top bit set in the
+// first one, clamped to MESSAGE_AGE_MAX.
+const uint8_t MESSAGE_FRAME_VERSION_2 = 0x80;
+const uint8_t MESSAGE_FRAME_VERSION_MASK = 0x80;
+const uint8_t MESSAGE_FRAME_TIMESTAMPED = 0x40;
+const uint8_t MESSAGE_FRAME_COUNT_MASK = 0x3F;
+const uint8_t MESSAGE_FRAME_HEADER_SIZE = 2;
+const uint8_t MESSAGE_FRAME_TIME_SIZE = 2;
+const uint8_t MESSAGE_FRAME_MAX_SIZE = 32; // BUFFER_LENGTH in Wire
+const uint8_t MESSAGE_TIME_SHIFT = 4; // 16 us units
+const uint8_t MESSAGE_AGE_MAX_SIZE = 2;
+const uint16_t MESSAGE_AGE_MAX = 0x7FFF;
+
+inline bool isMessageFrame(const uint8_t* frame) {
+  return (frame[0] & MESSAGE_FRAME_VERSION_MASK) == MESSAGE_FRAME_VERSION_2;
+}
+
+inline bool isTimestampedFrame(const uint8_t* frame) {
+  return frame[0] & MESSAGE_FRAME_TIMESTAMPED;
+}
+
+inline uint8_t messageFrameEventCount(const uint8_t* frame) {
+  return frame[0] & MESSAGE_FRAME_COUNT_MASK;
+}
+
+inline uint8_t messageFrameAddress(const uint8_t* frame) {
+  return frame[1];
+}
+
+inline void writeMessageFrameHeader(uint8_t* frame, uint8_t address, uint8_t eventCount) {
+  frame[0] = MESSAGE_FRAME_VERSION_2 | eventCount;
+  frame[1] = address;
+}
+
+// After writeMessageFrameHeader(), the events start at MESSAGE_FRAME_HEADER_SIZE + MESSAGE_FRAME_TIME_SIZE
+inline void writeMessageFrameTime(uint8_t* frame, uint16_t time) {
+  frame[0] |= MESSAGE_FRAME_TIMESTAMPED;
+  frame[MESSAGE_FRAME_HEADER_SIZE] = time >> 8;
+  frame[MESSAGE_FRAME_HEADER_SIZE + 1] = time & 0xFF;
+}
+
+// Returns the number of bytes written to data (at most MESSAGE_AGE_MAX_SIZE)
+inline uint8_t encodeMessageAge(uint8_t* data, uint16_t age) {
+  if (age < 0x80) {
+    data[0] = age;
+    return 1;
+  }
+  if (age > MESSAGE_AGE_MAX) {
+    age = MESSAGE_AGE_MAX;
+  }
+  data[0] = 0x80 | (age >> 8);
+  data[1] = age & 0xFF;
+  return 2;
+}
+
+// Returns the number of bytes read from data or 0 if the age is truncated
+inline uint8_t decodeMessageAge(const uint8_t* data, uint8_t length, uint16_t& age) {
+  if (length < 1) {
+    return 0;
+  }
+  if (!(data[0] & 0x80)) {
+    age = data[0];
+    return 1;
+  }
+  if (length < 2) {
+    return 0;
+  }
+  age = ((data[0] & 0x7F) << 8) | data[1];
+  return 2;
+}
+
+typedef void (*MessageHandler)(const SlaveToMasterMessage&);
+
+// Decodes a v2 frame and passes each event to handler. Returns the number of handled events.
+// nowMicros is the master's micros(): the event time of frames without timestamps, and for the
+// others the reference that the 16 bit frame time is extended with. Frame times within about
+// 0.5 s of it are placed correctly, the slave clocks may run a little ahead of the master's.
+inline uint8_t dispatchMessageFrame(const uint8_t* frame, uint8_t length, MessageHandler handler, uint32_t nowMicros) {
+  if (length < MESSAGE_FRAME_HEADER_SIZE || !isMessageFrame(frame)) {
+    return 0;
+  }
+
+  const bool timestamped = isTimestampedFrame(frame);
+  uint8_t offset = MESSAGE_FRAME_HEADER_SIZE;
+  uint32_t frameMicros = nowMicros;
+  if (timestamped) {
+    if (length < MESSAGE_FRAME_HEADER_SIZE + MESSAGE_FRAME_TIME_SIZE) {
+      return 0;
+    }
+    const uint16_t frameTime = (frame[offset] << 8) | frame[offset + 1];
+    const int16_t frameAge = (uint16_t) (nowMicros >> MESSAGE_TIME_SHIFT) - frameTime;
+    frameMicros = nowMicros - ((int32_t) frameAge << MESSAGE_TIME_SHIFT);
+    offset += MESSAGE_FRAME_TIME_SIZE;
+  }
+
+  const uint8_t eventCount = messageFrameEventCount(frame);
+  uint8_t handled = 0;
+  for (; handled < eventCount; ++handled) {
+    SlaveToMasterMessage message;
+    const uint8_t messageLength = decodeMessage(frame + offset, length - offset, message);
+    if (messageLength == 0) {
+      break;
+    }
+    offset += messageLength;
+    message.time = frameMicros;
+    message.timestamped = timestamped;
+    if (timestamped) {
+      uint16_t age;
+      const uint8_t ageLength = decodeMessageAge(frame + offset, length - offset, age);
+      if (ageLength == 0) {
+        break;
+      }
+      offset += ageLength;
+      message.time -= (uint32_t) age << MESSAGE_TIME_SHIFT;
+    }
+    message.address = messageFrameAddress(frame);
+    handler(message);
+  }
+  return handled;
+}
+
+// Polling: the master writes POLL_LENGTH_COMMAND and reads, with a repeated start, one byte with
+// the length of the pending frame and its sequence bit (0 when there is nothing to send). Then it
+// writes POLL_FRAME_COMMAND and reads the frame. The slave keeps answering with the same frame
+// until the master writes [POLL_ACK_COMMAND][length byte], so a failed or short read loses
+// nothing. The sequence bit keeps a repeated acknowledgement from releasing the next frame.
+const uint8_t POLL_LENGTH_COMMAND = 0x7B;
+const uint8_t POLL_FRAME_COMMAND = 0x7C;
+const uint8_t POLL_ACK_COMMAND = 0x7D;
+const uint8_t POLL_LENGTH_SIZE = 1;
+const uint8_t POLL_ACK_SIZE = 2;
+const uint8_t POLL_LENGTH_MASK = 0x3F;
+const uint8_t POLL_SEQUENCE_BIT = 0x40;
+
+// Board config: the master writes [BOARD_CONFIG_COMMAND][config] to a slave, which stores the
+// config in its EEPROM, applies it and answers with a DEBUG_BOARD_CONFIG message.
+// Config: [BOARD_CONFIG_VERSION][board count][board]...[checksum]
+// Board: [features][BOARD_CONFIG_FLAG_*][min position][max position]
+// The features can only turn off what the slave firmware was built with.
+const uint8_t BOARD_CONFIG_COMMAND = CONTROL_TYPE_DATA;
+const uint8_t BOARD_CONFIG_VERSION = 1;
+const uint8_t BOARD_CONFIG_HEADER_SIZE = 2;
+const uint8_t BOARD_CONFIG_BOARD_SIZE = 4;
+const uint8_t BOARD_CONFIG_MAX_BOARDS = 6;
+const uint8_t BOARD_CONFIG_MAX_SIZE = BOARD_CONFIG_HEADER_SIZE + BOARD_CONFIG_MAX_BOARDS * BOARD_CONFIG_BOARD_SIZE + 1;
+
+const uint8_t BOARD_CONFIG_FLAG_RELATIVE = 0x01;
+const uint8_t BOARD_CONFIG_FLAG_CCW = 0x02;
+const uint8_t BOARD_CONFIG_FLAG_LOOP = 0x04; // Absolute encoders wrap around at the limits
+
+inline uint8_t boardConfigSize(uint8_t boardCount) {
+  return BOARD_CONFIG_HEADER_SIZE + boardCount * BOARD_CONFIG_BOARD_SIZE + 1;
+}
+
+// Over everything but the checksum byte at the end
+inline uint8_t boardConfigChecksum(const uint8_t* config, uint8_t length) {
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < length - 1; ++i) {
+    sum += config[i];
+  }
+  return ~sum;
+}
+
+inline bool isValidBoardConfig(const uint8_t* config, uint8_t length, uint8_t boardCount) {
+  return length == boardConfigSize(boardCount) &&
+    config[0] == BOARD_CONFIG_VERSION &&
+    config[1] == boardCount &&
+    config[length - 1] == boardConfigChecksum(config, length);
+}
+
 const byte MASTER_ADDRESS = 1;
-const byte ADDRESS_LENGTH = 1;
+const uint8_t FIRST_SLAVE_ADDRESS = MASTER_ADDRESS + 1;
+const uint8_t MAX_SLAVE_ADDRESS = 0x77;
+const uint8_t SLAVE_ADDRESS_COUNT = MAX_SLAVE_ADDRESS - FIRST_SLAVE_ADDRESS + 1;
+
+// Fast mode needs the external pull-ups (4.7k or less), the internal ones only work at 100 kHz.
+// The TWI bit rate is F_CPU / (16 + 2 * TWBR): 500 kHz is the limit of the 8 MHz slaves.
+const uint32_t I2C_CLOCK_HZ = 400000;
+// Bus waits give up after this and free the bus (Wire.setWireTimeout)
+const uint32_t I2C_TIMEOUT_MICROS = 10000;
+#ifdef F_CPU
+static_assert(I2C_CLOCK_HZ * 16 <= F_CPU, "I2C_CLOCK_HZ is above what the TWI can do at this F_CPU");
+#endif
+
+// Address enumeration: a slave without an address writes [ADDRESS_REQUEST_COMMAND][unique id]
+// to the master and, after a repeated start, reads [unique id][address] back. The repeated start
+// keeps other slaves off the bus in between. Slaves that start at the same time are sorted out by
+// the I2C arbitration: the lowest id wins and endTransmission() fails for the others, which retry
+// after a random wait of up to addressRequestBackoffMillis(failures). The master gives an id the
+// same address on every request, so a retry after a lost answer does not use up an address.
+// Neither a slave address (v1 message) nor a v2 frame header
+const uint8_t ADDRESS_REQUEST_COMMAND = 0x7F;
+const uint8_t UNIQUE_ID_SIZE = 4;
+const uint8_t ADDRESS_REQUEST_SIZE = 1 + UNIQUE_ID_SIZE;
+const uint8_t ADDRESS_RESPONSE_SIZE = UNIQUE_ID_SIZE + 1;
+const uint8_t NO_ADDRESS = 0xFF; // Answered when all addresses are taken
+const uint8_t ADDRESS_REQUEST_FIRST_BACKOFF_MILLIS = 1;
+const uint8_t ADDRESS_REQUEST_MAX_BACKOFF_SHIFT = 4;
+
+inline uint16_t addressRequestBackoffMillis(uint8_t failures) {
+  return ADDRESS_REQUEST_FIRST_BACKOFF_MILLIS << (failures < ADDRESS_REQUEST_MAX_BACKOFF_SHIFT ? failures : ADDRESS_REQUEST_MAX_BACKOFF_SHIFT);
+}
+
+inline bool isValidSlaveAddress(uint8_t address) {
+  return address >= FIRST_SLAVE_ADDRESS && address <= MAX_SLAVE_ADDRESS;
+}
+
+// Time sync: the master writes [TIME_SYNC_COMMAND][micros(), 4 bytes big endian] to the general
+// call address every TIME_SYNC_PERIOD_MILLIS. The slaves keep the offset to their own micros()
+// and stamp their frames with the master's clock from then on, so the master can order the events
+// of different boards and time encoder turns. Between the syncs the slave clocks drift by their
+// oscillator tolerance; the master's own frames delay the write by up to a frame time.
+const uint8_t GENERAL_CALL_ADDRESS = 0;
+const uint8_t TIME_SYNC_COMMAND = 0x7E;
+const uint8_t TIME_SYNC_SIZE = 5;
+const uint16_t TIME_SYNC_PERIOD_MILLIS = 100;
+// From the master's micros() to the slave's receive interrupt: the bits of the address and the sync
+const uint32_t TIME_SYNC_TRANSFER_MICROS = 9 * (1 + TIME_SYNC_SIZE) * 1000000UL / I2C_CLOCK_HZ;
+
+inline void writeTimeSync(uint8_t* data, uint32_t micros) {
+  data[0] = TIME_SYNC_COMMAND;
+  for (uint8_t i = 0; i < 4; ++i) {
+    data[1 + i] = micros >> (24 - 8 * i);
+  }
+}
+
+inline uint32_t readTimeSync(const uint8_t* data) {
+  uint32_t micros = 0;
+  for (uint8_t i = 0; i < 4; ++i) {
+    micros = (micros << 8) | data[1 + i];
+  }
+  return micros;
+}
+
+// Profiler (slaves built with PROFILER_ENABLED): the master writes [PROFILE_REQUEST_COMMAND][flags]
+// and the slave answers over its next update() passes with CONTROL_TYPE_DEBUG messages, one per
+// section and stat, with the input debugProfileInput(section, stat). Durations are CPU cycles.
+const uint8_t PROFILE_REQUEST_COMMAND = CONTROL_TYPE_DEBUG;
+const uint8_t PROFILE_REQUEST_SIZE = 2;
+const uint8_t PROFILE_REQUEST_RESET = 0x01; // Clear the table after the answer
+
+enum ProfileSection {
+  PROFILE_SECTION_UPDATE, // All of Slave_::update()
+  PROFILE_SECTION_BUTTONS, // Button ladder decoding, updateSwitchStates()
+  PROFILE_SECTION_SWITCH_EVENTS, // The switch events of the ladders, handleSwitchStates()
+  PROFILE_SECTION_PADS,
+  PROFILE_SECTION_TOUCH,
+  PROFILE_SECTION_MATRIX, // Matrix events, the scan is PROFILE_SECTION_TIMER2
+  PROFILE_SECTION_POTS,
+  PROFILE_SECTION_ENCODERS,
+  PROFILE_SECTION_TX, // flushMessagesToMaster()
+  PROFILE_SECTION_LEDS, // refreshLeds()
+  PROFILE_SECTION_PCINT0,
+  PROFILE_SECTION_PCINT1,
+  PROFILE_SECTION_PCINT2,
+  PROFILE_SECTION_ADC,
+  PROFILE_SECTION_TIMER2,
+  PROFILE_SECTION_COUNT
+};
+
+enum ProfileStat {
+  PROFILE_STAT_CALLS, // Saturates at 0xFFFF, the other stats stop there too
+  PROFILE_STAT_MIN,
+  PROFILE_STAT_MAX,
+  PROFILE_STAT_MEAN,
+  PROFILE_STAT_COUNT
+};
+
+inline uint8_t debugProfileInput(uint8_t section, uint8_t stat) {
+  return DEBUG_PROFILE + section * PROFILE_STAT_COUNT + stat;
+}
@@ -14,93 +14,69 @@
 #define BOARD_FEATURES_R1 (BOARD_FEATURE_ENCODER | BOARD_FEATURE_BUTTON | BOARD_FEATURE_LED)
 #define BOARD_FEATURES_R2 (BOARD_FEATURE_ENCODER | BOARD_FEATURE_BUTTON | BOARD_FEATURE_LED)
 
-static const byte BOARD_FEATURES[] = {
-  BOARD_FEATURES_L1,
-  BOARD_FEATURES_L2,
-
+// In Board order. The features are known at compile time, so code that is specialized per board
+// (Slave_::updateEncoder<BOARD>()) compiles away the features a board is not built with.
+// The encoder settings are the defaults of the board config that the master can overwrite.
+static constexpr BoardDescriptor BOARD_DESCRIPTORS[] = {
+  // Features, LEDs, encoder type, direction, position limits, loop
+  {BOARD_FEATURES_L1, 4, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 3, false},
+  {BOARD_FEATURES_L2, 4, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 3, false},
 #if PCB_VERSION == 3
-  BOARD_FEATURES_M1,
-  BOARD_FEATURES_M2,
+  {BOARD_FEATURES_M1, 4, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 3, false},
+  {BOARD_FEATURES_M2, 4, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 3, false},
 #else
-  BOARD_FEATURES_M,
-#endif
-
-  BOARD_FEATURES_R1,
-  BOARD_FEATURES_R2,
-};
-
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
-static const byte LED_COUNTS[] = {
-  4,
-  4,
-#if PCB_VERSION == 3
-  4,
+  {BOARD_FEATURES_M, 4, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 3, false},
 #endif
-  4,
-  12,
-  12
+  {BOARD_FEATURES_R1, 12, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 11, true},
+  {BOARD_FEATURES_R2, 12, ENCODER_TYPE_ABSOLUTE, ENCODE_DIRECTION_CW, 0, 11, true},
 };
-#endif
+static_assert(sizeof(BOARD_DESCRIPTORS) / sizeof(BOARD_DESCRIPTORS[0]) == BOARD_COUNT, "One descriptor per board");
 
 #if PCB_VERSION == 3
-static const int LED_COUNT_L = LED_COUNTS[BOARD_L1] + LED_COUNTS[BOARD_L2];
-static const int LED_COUNT_M = LED_COUNTS[BOARD_M1] + LED_COUNTS[BOARD_M2];
-static const int LED_COUNT_R = LED_COUNTS[BOARD_R1] + LED_COUNTS[BOARD_R2];
+static constexpr int LED_COUNT_L = BOARD_DESCRIPTORS[BOARD_L1].ledCount + BOARD_DESCRIPTORS[BOARD_L2].ledCount;
+static constexpr int LED_COUNT_M = BOARD_DESCRIPTORS[BOARD_M1].ledCount + BOARD_DESCRIPTORS[BOARD_M2].ledCount;
+static constexpr int LED_COUNT_R = BOARD_DESCRIPTORS[BOARD_R1].ledCount + BOARD_DESCRIPTORS[BOARD_R2].ledCount;
 #else
-static const int LED_COUNT_LM = LED_COUNTS[BOARD_L1] + LED_COUNTS[BOARD_L2] + LED_COUNTS[BOARD_M];
-static const int LED_COUNT_R = LED_COUNTS[BOARD_R1] + LED_COUNTS[BOARD_R2];
-#endif
-
-static const byte ENCODER_TYPES[] = {
-  ENCODER_TYPE_ABSOLUTE,
-  ENCODER_TYPE_ABSOLUTE,
-  ENCODER_TYPE_ABSOLUTE,
-#if PCB_VERSION == 3
-  ENCODER_TYPE_ABSOLUTE,
+static constexpr int LED_COUNT_LM = BOARD_DESCRIPTORS[BOARD_L1].ledCount + BOARD_DESCRIPTORS[BOARD_L2].ledCount + BOARD_DESCRIPTORS[BOARD_M].ledCount;
+static constexpr int LED_COUNT_R = BOARD_DESCRIPTORS[BOARD_R1].ledCount + BOARD_DESCRIPTORS[BOARD_R2].ledCount;
 #endif
-  ENCODER_TYPE_ABSOLUTE,
-  ENCODER_TYPE_ABSOLUTE
-};
 
-static const EncoderDirection ENCODER_DIRECTIONS[] = {
-  ENCODE_DIRECTION_CW,
-  ENCODE_DIRECTION_CW,
-  ENCODE_DIRECTION_CW,
-#if PCB_VERSION == 3
-  ENCODE_DIRECTION_CW,
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
+// A button ladder state is reported once the samples have stayed in it for BUTTON_SETTLE_MILLIS.
+// The window of the reported state is BUTTON_VOLTAGE_HYSTERESIS wider than the other ones.
+static const uint8_t BUTTON_SETTLE_MILLIS = 5;
+static const uint8_t BUTTON_VOLTAGE_HYSTERESIS = 20;
 #endif
-  ENCODE_DIRECTION_CW,
-  ENCODE_DIRECTION_CW
-};
 
-static const byte ENCODER_POSITION_LIMITS[] = {
-  0, 3,
-  0, 3,
-#if PCB_VERSION == 3
-  0, 3,
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+// show() blocks the encoder interrupts for ~30us per LED. LED frames are shown at most once per
+// LED_MIN_REFRESH_INTERVAL milliseconds and held back while an encoder has moved within the last
+// LED_ENCODER_QUIET_INTERVAL milliseconds, but never for longer than LED_MAX_DEFER_INTERVAL.
+static const uint8_t LED_MIN_REFRESH_INTERVAL = 20;
+static const uint8_t LED_ENCODER_QUIET_INTERVAL = 10;
+static const uint8_t LED_MAX_DEFER_INTERVAL = 100;
 #endif
-  0, 3,
-  0, 11,
-  0, 11
-};
 
-static const bool ENCODER_LOOP[] {
-  false,
-  false,
-#if PCB_VERSION == 3
-  false,
+// Relative encoders: multiply the sent delta by the factor of the first interval
+// (milliseconds per detent) that the turning speed does not exceed
+//#define ENCODER_ACCELERATION_ENABLED
+#ifdef ENCODER_ACCELERATION_ENABLED
+static const uint8_t ENCODER_ACCELERATION_INTERVALS[] = {5, 15, 40};
+static const uint8_t ENCODER_ACCELERATION_FACTORS[] = {8, 4, 2};
 #endif
-  false,
-  true,
-  true
-};
 
 //#define USART_DEBUG_ENABLED // Disable some LEDs if you enable this. Otherwise you will run out of memory!
+#ifdef USART_DEBUG_ENABLED
+// Tokenized, decode the output with log_decoder/. Points above the level are compiled out.
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
 //#define I2C_DEBUG_ENABLED
 //#define PORT_STATE_DEBUG
 //#define INTERRUPT_DEBUG
 //#define ENCODER_PIN_DEBUG
 //#define SKIP_FEATURE_VALIDATION
+// Cycle counts of the update() sections and ISRs on Timer1, the master reads them with PROFILE_REQUEST_COMMAND
+//#define PROFILER_ENABLED
 #define BOARD_HAS_DEBUG_LED
 
 #include "feature_validation.h"
@@ -3,25 +3,35 @@
 #include "slave.h"
 #include "config.h"
 
+#if PCB_VERSION == 3
+// PORT_PINS is the port state read once at the start of the ISR
+#define DECODE_BOARD(BOARD_ID, PORT_PINS) \
+if (HAS_FEATURE(BOARD_ID, BOARD_FEATURE_ENCODER)) {\
+  Slave.decodeEncoder(BOARD_##BOARD_ID, PORT_PINS);\
+}
+#else
 #define TICK_BOARD(BOARD_ID) \
 if (HAS_FEATURE(BOARD_ID, BOARD_FEATURE_ENCODER)) {\
   Slave.tickEncoder(BOARD_##BOARD_ID);\
 }
+#endif
 
 // !!NOTE!!: Do not call sendChangeMessage in ISRs
 ISR(PCINT0_vect) {
+  PROFILE_SCOPE(Slave.profiler, PROFILE_SECTION_PCINT0);
 // TODO: where to put interrupter?
 //#if defined(USART_DEBUG_ENABLED) && defined(INTERRUPT_DEBUG)
 //  interrupter = 0;
 //#endif
 
-  TICK_BOARD(R2);
-
 #if PCB_VERSION == 3
-  TICK_BOARD(M2);
+  const uint8_t portPins = PINB;
+  DECODE_BOARD(R2, portPins);
+  DECODE_BOARD(M2, portPins);
 
 #else
 
+  TICK_BOARD(R2);
   TICK_BOARD(R1);
   
   #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS)
@@ -33,13 +43,14 @@ ISR(PCINT0_vect) {
 
 // !!NOTE!!: Do not call sendChangeMessage in ISRs
 ISR(PCINT1_vect) {
+  PROFILE_SCOPE(Slave.profiler, PROFILE_SECTION_PCINT1);
 // TODO: where to put interrupter?
 //#if defined(USART_DEBUG_ENABLED) && defined(INTERRUPT_DEBUG)
 //  interrupter = 1;
 //#endif
 
 #if PCB_VERSION == 3
-  TICK_BOARD(L1);
+  DECODE_BOARD(L1, PINC);
 
 #elif PCB_VERSION == 1
   TICK_BOARD(R2);
@@ -58,22 +69,24 @@ ISR(PCINT1_vect) {
 
 #endif
 
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION != 3 // v3 buttons are polled from update()
   Slave.updateSwitchStates();
 #endif
 }
 
 // !!NOTE!!: Do not call sendChangeMessage in ISRs
 ISR(PCINT2_vect) {
+  PROFILE_SCOPE(Slave.profiler, PROFILE_SECTION_PCINT2);
 // TODO: where to put interrupter?
 //#if defined(USART_DEBUG_ENABLED) && defined(INTERRUPT_DEBUG)
 //  interrupter = 2;
 //#endif
 
 #if PCB_VERSION == 3
-  TICK_BOARD(M1);
-  TICK_BOARD(L2);
-  TICK_BOARD(R1);
+  const uint8_t portPins = PIND;
+  DECODE_BOARD(M1, portPins);
+  DECODE_BOARD(L2, portPins);
+  DECODE_BOARD(R1, portPins);
 #else
 
   TICK_BOARD(M);
@@ -83,11 +96,10 @@ ISR(PCINT2_vect) {
     Slave.updatePadStates();
   #endif
 
-#endif
-
   TICK_BOARD(L2);
+#endif
 
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION != 3 // v3 buttons are polled from update()
   Slave.updateSwitchStates();
 #endif
 
@@ -97,3 +109,17 @@ ISR(PCINT2_vect) {
 #endif
 #endif
 }
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+ISR(ADC_vect) {
+  PROFILE_SCOPE(Slave.profiler, PROFILE_SECTION_ADC);
+  Slave.handleButtonSample();
+}
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+ISR(TIMER2_COMPA_vect) {
+  PROFILE_SCOPE(Slave.profiler, PROFILE_SECTION_TIMER2);
+  Slave.scanMatrices();
+}
+#endif
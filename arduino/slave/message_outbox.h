@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "shared.h"
+#include "ring_buffer.h"
+
+// Messages waiting for the next frame to the master, only used from the main loop.
+// Absolute values (CONTROL_TYPE_POSITION of inputs below SLOT_COUNT) have one slot per
+// input that a newer value overwrites, so a congested bus delays them without building up a
+// backlog: only the latest position goes out. Everything else (button edges, encoder deltas,
+// debug messages) goes through a FIFO and is sent in order. A frame carries the FIFO messages
+// first and then the pending slots. Times are in MESSAGE_TIME_SHIFT units, see shared.h.
+template<uint8_t SLOT_COUNT, uint8_t FIFO_SIZE>
+class MessageOutbox
+{
+public:
+  static_assert(SLOT_COUNT <= 8, "MessageOutbox slots are tracked in one byte");
+
+  // Returns false if the FIFO is full
+  bool push(uint8_t input, uint16_t value, ControlType type, uint16_t time) {
+    if (type == CONTROL_TYPE_POSITION && input < SLOT_COUNT) {
+      slotValues[input] = value;
+      slotTimes[input] = time;
+      pendingSlots |= 1 << input;
+      // The new value has not been sent yet, consumeFrame() must not clear it
+      frameSlots &= ~(1 << input);
+      return true;
+    }
+    const QueuedMessage message = {input, (uint8_t) type, value, time};
+    return fifo.push(message);
+  }
+
+  // Messages that push() still takes without an overwritten slot
+  uint8_t fifoSpace() const {
+    return FIFO_SIZE - 1 - fifo.available();
+  }
+
+  bool isEmpty() const {
+    return pendingSlots == 0 && fifo.available() == 0;
+  }
+
+  // Encodes as many pending messages as fit into a v2 frame and returns its length. They stay
+  // in the outbox until consumeFrame(), which the caller runs once the frame is handed off.
+  // With timestamped, the frame carries frameTime and every event its age.
+  uint8_t writeFrame(uint8_t* frame, uint8_t address, bool timestamped, uint16_t frameTime) {
+    uint8_t length = MESSAGE_FRAME_HEADER_SIZE + (timestamped ? MESSAGE_FRAME_TIME_SIZE : 0);
+    SlaveToMasterMessage message = {address, 0, CONTROL_TYPE_DEBUG, 0, 0, false};
+
+    const uint8_t queued = fifo.available();
+    for (frameFifoCount = 0; frameFifoCount < queued; ++frameFifoCount) {
+      const QueuedMessage& queuedMessage = fifo.peek(frameFifoCount);
+      message.input = queuedMessage.input;
+      message.type = (ControlType) queuedMessage.type;
+      message.value = queuedMessage.value;
+      if (!append(frame, length, message, timestamped, frameTime - queuedMessage.time)) {
+        break;
+      }
+    }
+
+    frameSlots = 0;
+    message.type = CONTROL_TYPE_POSITION;
+    for (uint8_t input = 0; input < SLOT_COUNT; ++input) {
+      if (pendingSlots & (1 << input)) {
+        message.input = input;
+        message.value = slotValues[input];
+        if (!append(frame, length, message, timestamped, frameTime - slotTimes[input])) {
+          break;
+        }
+        frameSlots |= 1 << input;
+      }
+    }
+
+    writeMessageFrameHeader(frame, address, frameEventCount());
+    if (timestamped) {
+      writeMessageFrameTime(frame, frameTime);
+    }
+    return length;
+  }
+
+  // Messages of the last writeFrame() that are still pending
+  uint8_t frameEventCount() const {
+    uint8_t count = frameFifoCount;
+    for (uint8_t slots = frameSlots; slots; slots &= slots - 1) {
+      count++;
+    }
+    return count;
+  }
+
+  // The 16-bit times wrap after ~1 s in the outbox. Called at least every MESSAGE_AGE_MAX
+  // units (~0.5 s), this keeps the older messages at MESSAGE_AGE_MAX instead.
+  void clampAges(uint16_t now) {
+    const uint8_t queued = fifo.available();
+    for (uint8_t i = 0; i < queued; ++i) {
+      clampTime(fifo.peek(i).time, now);
+    }
+    for (uint8_t input = 0; input < SLOT_COUNT; ++input) {
+      if (pendingSlots & (1 << input)) {
+        clampTime(slotTimes[input], now);
+      }
+    }
+  }
+
+  // Removes the messages of the last writeFrame()
+  void consumeFrame() {
+    fifo.consume(frameFifoCount);
+    pendingSlots &= ~frameSlots;
+    frameFifoCount = 0;
+    frameSlots = 0;
+  }
+
+private:
+  static void clampTime(uint16_t& time, uint16_t now) {
+    if ((uint16_t) (now - time) > MESSAGE_AGE_MAX) {
+      time = now - MESSAGE_AGE_MAX;
+    }
+  }
+
+  // Returns false and leaves the frame as it is when the event does not fit
+  static bool append(uint8_t* frame, uint8_t& length, const SlaveToMasterMessage& message, bool timestamped, uint16_t age) {
+    uint8_t event[MESSAGE_MAX_ENCODED_SIZE + MESSAGE_AGE_MAX_SIZE];
+    uint8_t eventLength = encodeMessage(event, message);
+    if (timestamped) {
+      eventLength += encodeMessageAge(event + eventLength, age);
+    }
+    if (length + eventLength > MESSAGE_FRAME_MAX_SIZE) {
+      return false;
+    }
+    memcpy(frame + length, event, eventLength);
+    length += eventLength;
+    return true;
+  }
+
+  // The address is the same for all messages, it goes into the frame header
+  struct QueuedMessage {
+    uint8_t input;
+    uint8_t type; // ControlType
+    uint16_t value;
+    uint16_t time;
+  };
+
+  RingBuffer<QueuedMessage, FIFO_SIZE> fifo;
+  uint16_t slotValues[SLOT_COUNT];
+  uint16_t slotTimes[SLOT_COUNT];
+  uint8_t pendingSlots = 0;
+  uint8_t frameFifoCount = 0; // Messages of the last writeFrame()
+  uint8_t frameSlots = 0;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "shared.h"
+
+// Cycle counts of the update() sections and the ISRs, read from Timer1 free running at F_CPU.
+// A section longer than 65535 cycles (8 ms at 8 MHz) wraps around. The update() sections include
+// the time of the ISRs that interrupt them, compare them with the ISR sections. The update()
+// sections are only recorded from the main loop and each ISR section only from its own ISR,
+// so only reading and resetting the table have to block the interrupts.
+class Profiler
+{
+public:
+  struct Entry {
+    uint16_t calls;
+    uint16_t minCycles;
+    uint16_t maxCycles;
+    uint32_t totalCycles;
+  };
+
+  // Takes over Timer1, which the slave does not use otherwise
+  void begin() {
+    reset();
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+  }
+
+  void record(ProfileSection section, uint16_t cycles) {
+    Entry& entry = entries[section];
+    if (entry.calls == UINT16_MAX) {
+      return;
+    }
+    if (entry.calls == 0 || cycles < entry.minCycles) {
+      entry.minCycles = cycles;
+    }
+    if (cycles > entry.maxCycles) {
+      entry.maxCycles = cycles;
+    }
+    entry.totalCycles += cycles;
+    entry.calls++;
+  }
+
+  Entry read(ProfileSection section) const {
+    Entry entry;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      entry = entries[section];
+    }
+    return entry;
+  }
+
+  static uint16_t stat(const Entry& entry, ProfileStat stat) {
+    switch (stat) {
+      case PROFILE_STAT_CALLS:
+        return entry.calls;
+      case PROFILE_STAT_MIN:
+        return entry.minCycles;
+      case PROFILE_STAT_MAX:
+        return entry.maxCycles;
+      case PROFILE_STAT_MEAN:
+        return entry.calls ? entry.totalCycles / entry.calls : 0;
+      default:
+        return 0;
+    }
+  }
+
+  void reset() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      memset(entries, 0, sizeof(entries));
+    }
+  }
+
+private:
+  Entry entries[PROFILE_SECTION_COUNT];
+};
+
+// Records the cycles from here to the end of the enclosing scope
+class ProfileScope
+{
+public:
+  ProfileScope(Profiler& profiler, ProfileSection section) : profiler(profiler), section(section), start(TCNT1) {}
+  ~ProfileScope() {
+    profiler.record(section, TCNT1 - start);
+  }
+
+private:
+  Profiler& profiler;
+  const ProfileSection section;
+  const uint16_t start;
+};
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_SCOPE(PROFILER, SECTION) ProfileScope profileScope(PROFILER, SECTION)
+#else
+#define PROFILE_SCOPE(PROFILER, SECTION)
+#endif
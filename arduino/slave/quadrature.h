@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <util/atomic.h>
+
+// Indexed with (previousState << 2) | currentState where state = A | (B << 1).
+// Transitions where both pins changed are invalid and ignored.
+static const int8_t QUADRATURE_TRANSITIONS[16] = {
+   0, -1,  1,  0,
+   1,  0,  0, -1,
+  -1,  0,  0,  1,
+   0,  1, -1,  0
+};
+
+// Both pins are pulled up between detents
+static const uint8_t QUADRATURE_LATCH_STATE = 3;
+
+// Drop-in replacement for RotaryEncoder that does not read the pins itself.
+// The PCINT handlers read the whole port once and pass the pin states of
+// each encoder on that port to tick(). The counters are 16 bits and wrap, the
+// detents since the last takeDelta() are counted separately so that relative
+// mode never sees the wrap.
+class QuadratureEncoder
+{
+public:
+  inline void tick(uint8_t pinStates) {
+    steps += QUADRATURE_TRANSITIONS[(state << 2) | pinStates];
+    if (pinStates == QUADRATURE_LATCH_STATE && state != QUADRATURE_LATCH_STATE) {
+      // Truncated towards zero, an unfinished detent stays in steps
+      const int16_t detents = (int16_t) (steps - latchedSteps) / 4;
+      latchedSteps += detents * 4;
+      position += detents;
+      if (detents > 0 ? delta <= INT16_MAX - detents : delta >= INT16_MIN - detents) {
+        delta += detents;
+      }
+      latchMicros = micros();
+    }
+    state = pinStates;
+  }
+
+  // micros() of the last edge into the latch state, i.e. the edge that completed a detent
+  uint32_t getLatchMicros() {
+    uint32_t current;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      current = latchMicros;
+    }
+    return current;
+  }
+
+  int16_t getPosition() {
+    uint16_t current;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      current = position;
+    }
+    return (int16_t) current;
+  }
+
+  // Detents turned since they were last taken, saturates at the int16_t range
+  int16_t getDelta() {
+    int16_t current;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      current = delta;
+    }
+    return current;
+  }
+
+  // Takes at most limit detents either way, the rest stays for the next call
+  int16_t takeDelta(int16_t limit) {
+    int16_t taken;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      taken = constrain(delta, -limit, limit);
+      delta -= taken;
+    }
+    return taken;
+  }
+
+  int8_t getDirection() {
+    const int current = getPosition();
+    const int8_t direction = current > previousPosition ? 1 : current < previousPosition ? -1 : 0;
+    previousPosition = current;
+    return direction;
+  }
+
+  void setPosition(int16_t newPosition) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      steps = (steps - latchedSteps) + ((uint16_t) newPosition << 2);
+      latchedSteps = (uint16_t) newPosition << 2;
+      position = newPosition;
+    }
+    previousPosition = newPosition;
+  }
+
+private:
+  uint8_t state = QUADRATURE_LATCH_STATE;
+  volatile uint16_t steps = 0;
+  volatile uint16_t latchedSteps = 0; // steps at the last completed detent
+  volatile uint16_t position = 0;
+  volatile int16_t delta = 0;
+  volatile uint32_t latchMicros = 0;
+  int previousPosition = 0;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <util/atomic.h>
+
+// Single-producer / single-consumer ring buffer. The producer (an ISR or the main loop) only
+// writes head and the consumer only writes tail, so neither side needs to disable interrupts.
+// AVR ISRs do not nest, so all the input ISRs together count as one producer.
+// SIZE must be a power of two and at most 128.
+template<typename T, uint8_t SIZE>
+class RingBuffer
+{
+public:
+  static_assert(SIZE && (SIZE & (SIZE - 1)) == 0 && SIZE <= 128, "RingBuffer SIZE must be a power of two <= 128");
+
+  // Producer side
+  bool push(const T& item) {
+    const uint8_t next = (head + 1) & MASK;
+    if (next == tail) {
+      ++overflows;
+      return false;
+    }
+    buffer[head] = item;
+    // Make sure the item is stored before it is published to the consumer
+    __asm__ __volatile__("" ::: "memory");
+    head = next;
+    return true;
+  }
+
+  // Consumer side: available() snapshots head once so that a batch can be
+  // processed with peek() and released with a single consume()
+  uint8_t available() const {
+    const uint8_t count = (head - tail) & MASK;
+    __asm__ __volatile__("" ::: "memory");
+    return count;
+  }
+
+  const T& peek(uint8_t offset) const {
+    return buffer[(tail + offset) & MASK];
+  }
+
+  // The consumer may update the items that it has not consumed yet
+  T& peek(uint8_t offset) {
+    return buffer[(tail + offset) & MASK];
+  }
+
+  void consume(uint8_t count) {
+    __asm__ __volatile__("" ::: "memory");
+    tail = (tail + count) & MASK;
+  }
+
+  uint16_t getOverflowCount() const {
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      count = overflows;
+    }
+    return count;
+  }
+
+private:
+  static const uint8_t MASK = SIZE - 1;
+
+  T buffer[SIZE];
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+  volatile uint16_t overflows = 0;
+};
@@ -1,5 +1,6 @@
 #include <EEPROM.h>
 #include <Wire.h>
+#include <util/delay.h>
 
 #include "slave.h"
 #include "features.h"
@@ -58,8 +59,24 @@ void Slave_::setup(ChangeHandler changeHandler) {
 
   delay(10);
   setupI2c();
+  loadBoardConfig();
+#ifdef PROFILER_ENABLED
+  // Before the interrupts that it times
+  profiler.begin();
+#endif
 
   setupPinModes();
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+  setupButtonSampling();
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+  setupMatrixScanner();
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+  for (uint8_t i = 0; i < LED_CHAIN_COUNT; ++i) {
+    ledChains[i].begin();
+  }
+#endif
   // TODO: Move interrupt initializations to the loop in setupPinModes();
   setupInterrupts();
 
@@ -68,8 +85,102 @@ void Slave_::setup(ChangeHandler changeHandler) {
   switchStates = previousSwitchStates = getButtonStates(); // TODO: construct mask according to enabled buttons
   #endif
   // TODO: initialize touch states
+
+  flushMessagesToMaster();
 }
 
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+template<uint8_t BOARD>
+inline void Slave_::updateEncoder() {
+  if (!BOARD_DESCRIPTORS[BOARD].has(BOARD_FEATURE_ENCODER)) {
+    return;
+  }
+  const BoardSettings& settings = boardSettings[BOARD];
+  if (settings.encoderMode == ENCODER_MODE_DISABLED) {
+    return;
+  }
+
+  int position;
+  uint8_t positionChanged = false;
+  const int8_t directionMultiplier = settings.encoderDirection;
+
+  if (settings.encoderMode != ENCODER_MODE_RELATIVE) {
+    position = encoder(BOARD).getPosition() * directionMultiplier;
+    positionChanged = position != positions[BOARD];
+  } else {
+    #if PCB_VERSION == 3
+    const int16_t pending = encoder(BOARD).getDelta();
+    #else
+    // RotaryEncoder only has the position, the difference is taken wrap-safe
+    const int16_t pending = (int16_t) ((uint16_t) encoder(BOARD).getPosition() - (uint16_t) positions[BOARD]);
+    #endif
+    #ifdef ENCODER_ACCELERATION_ENABLED
+    const uint8_t factor = encoderAccelerationFactor(BOARD, pending);
+    #else
+    const uint8_t factor = 1;
+    #endif
+    // Send all detents turned since the previous pass. Whatever does not fit a
+    // single message, also after the acceleration, stays in the encoder for the next pass.
+    const int16_t limit = MAX_ENCODER_DELTA / factor;
+    #if PCB_VERSION == 3
+    const int16_t delta = encoder(BOARD).takeDelta(limit);
+    #else
+    const int16_t delta = constrain(pending, -limit, limit);
+    #endif
+    positions[BOARD] = (int16_t) ((uint16_t) positions[BOARD] + delta);
+    position = delta * factor * directionMultiplier;
+    positionChanged = position != 0;
+  }
+
+  #ifdef INTERRUPT_DEBUG
+  uint8_t stateA = digitalRead(ENCODER_PINS[BOARD][0]);
+  uint8_t stateB = digitalRead(ENCODER_PINS[BOARD][1]);
+
+  if (stateA != states[2*BOARD] || stateB != states[2*BOARD+1]) {
+    LOG(SLAVE_ENCODER_PINS, interrupter, BOARD, stateA, stateB);
+    states[2*BOARD] = stateA;
+    states[2*BOARD+1] = stateB;
+  }
+  #endif
+
+  if (positionChanged) {
+    #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+    lastEncoderActivityMillis = millis();
+    #endif
+    #if PCB_VERSION == 3
+    handlingEdge = true;
+    handledEdgeMicros = encoder(BOARD).getLatchMicros();
+    #endif
+    if (settings.encoderMode != ENCODER_MODE_RELATIVE) {
+      int limited = 0;
+      if (settings.encoderMode == ENCODER_MODE_LOOPED) {
+        limited = position > settings.maxPosition ? settings.minPosition : position < settings.minPosition ? settings.maxPosition : position;
+      } else {
+        limited = constrain(position, settings.minPosition, settings.maxPosition);
+      }
+      positions[BOARD] = limited;
+      if (position != limited) {
+        encoder(BOARD).setPosition(limited * directionMultiplier);
+      }
+      handler((Board) BOARD, CONTROL_TYPE_POSITION, 0, limited);
+    } else {
+      handler((Board) BOARD, CONTROL_TYPE_ENCODER, 0, position);
+    }
+    handlingEdge = false;
+  }
+}
+
+template<uint8_t BOARD>
+inline void Slave_::updateEncoders() {
+  updateEncoder<BOARD>();
+  updateEncoders<BOARD + 1>();
+}
+
+template<>
+inline void Slave_::updateEncoders<BOARD_COUNT>() {
+}
+#endif
+
 void Slave_::update() {
 #ifdef PORT_STATE_DEBUG
   uint8_t maskedPinC = PINC; // & 0x00001111;
@@ -86,130 +197,41 @@ void Slave_::update() {
   previousB = PINB;
   previousC = maskedPinC;
   previousD = PIND;
+  flushMessagesToMaster();
   return;
 #endif
 
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
-  for (uint8_t board = BOARD_L1; board <= BOARD_R1; ++board) {
-    if (BOARD_FEATURES[board] & BOARD_FEATURE_MATRIX) {
-      uint8_t boardMatrixIndex = BOARD_MATRIX_INDEX(board);
-      for (uint8_t output = 0; output < MATRIX_OUTPUTS; ++output) {
-        uint8_t inputStates = 0;
-        uint8_t previousInputStates = previousMatrixButtonStates[boardMatrixIndex][output];
-        digitalWrite(BUTTON_MATRIX_OUTPUT_PINS[boardMatrixIndex][output], LOW);
-        delay(10); // TODO: is this necessary?
-        for (uint8_t input = 0; input < MATRIX_INPUTS; ++input) {
-          uint8_t currentState = digitalRead(BUTTON_MATRIX_INPUT_PINS[boardMatrixIndex][input]) == HIGH ? 0 : 1;
-          if (currentState != bitRead(previousInputStates, input)) {
-            // TODO: this will conflict with button on M / M1 & M2
-            // TODO: use MATRIX instead of BUTTON
-            handler(CONTROL_TYPE_BUTTON, board, MATRIX_INPUTS * output + input, currentState)
-          }
-          bitWrite(inputStates, input, currentState);
-        }
-        digitalWrite(BUTTON_MATRIX_OUTPUT_PINS[boardMatrixIndex][output], HIGH);
-        previousMatrixButtonStates[boardMatrixIndex][output] = inputStates;
-      }
-    }
-  }
-#endif
+  PROFILE_SCOPE(profiler, PROFILE_SECTION_UPDATE);
 
-  // TODO: check touch
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
-  #if PCB_VERSION == 3
-  updateSwitchStates();
-  #endif
-  if (previousSwitchStates != switchStates) {
-    #ifdef USART_DEBUG_ENABLED
-    Serial.print("SWS: ");
-    Serial.println(switchStates);
-    #endif
-    uint8_t changed = previousSwitchStates ^ switchStates;
-    #ifdef USART_DEBUG_ENABLED
-    Serial.print("Ch: ");
-    Serial.println(changed);
-    #endif
-    if (changed) {
-      previousSwitchStates = switchStates;
-      #if PCB_VERSION == 3
-      for (uint8_t board = BOARD_L2; board <= BOARD_R2; ++board) {
-        if (changed & (1 << board)) {
-          handler((Board)board, CONTROL_TYPE_BUTTON, 0, switchStates & (1 << board) ? 0 : 1);
-        }
-      }
-      #else
-      for (uint8_t i = BOARD_L1; i <= BOARD_R1; ++i) {
-        uint8_t switchMask = (1 << SW_INTS[i]);
-        if (changed & switchMask) {
-          handler(i, CONTROL_TYPE_BUTTON, 0, (switchStates & switchMask) ? 0 : 1);
-        }
-      }
-      #endif
-    }
+  if (receivedBoardConfigLength) {
+    storeReceivedBoardConfig();
   }
-#endif
 
-#if PCB_VERSION != 3 // TODO
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH)
-  if (previousTouchStates != touchStates) {
-    #ifdef USART_DEBUG_ENABLED
-    Serial.print("TS: ");
-    Serial.println(touchStates);
-    #endif
-    uint8_t changed = previousTouchStates ^ touchStates;
-    previousTouchStates = touchStates;
-    #ifdef USART_DEBUG_ENABLED
-    Serial.print("Ch: ");
-    Serial.println(changed);
-    #endif
-    // TODO:
-    if (changed) {
-      for (uint8_t i = 0; i < 3; ++i) {
-        uint8_t switchMask = (1 << SW_INTS[i]);
-        if (changed & switchMask) {
-          handler(i, CONTROL_TYPE_TOUCH, 0, (switchStates & switchMask) ? 0 : 1);
-        }
-      }
-    }
+  // TODO: check touch
+#if HAS_INPUT_EVENTS
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+  {
+    PROFILE_SCOPE(profiler, PROFILE_SECTION_BUTTONS);
+    updateSwitchStates();
   }
-#endif
+  #endif
 
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS)
-  for (uint8_t board = 0; board < 3; board++) {
-    const uint8_t padStateIndex = board - 1;
-    const uint8_t boardPadStates = padStates[padStateIndex];
-    const uint8_t previousBoardPadStates = previousPadStates[padStateIndex];
-    if (previousBoardPadStates != boardPadStates) {
-      #ifdef USART_DEBUG_ENABLED
-      Serial.print("B: ");
-      Serial.println(board);
-      #endif
-      uint8_t changed = previousBoardPadStates ^ boardPadStates;
-      previousPadStates[padStateIndex] = boardPadStates;
-      #ifdef USART_DEBUG_ENABLED
-      Serial.print("Ch: ");
-      Serial.println(changed);
-      #endif
-      if (changed) {
-        for (uint8_t i = 0; i < 4; ++i) {
-          uint8_t padMask = (1 << i);
-          if (changed & padMask) {
-            uint8_t pinState = (boardPadStates & padMask) ? 1 : 0;
-            // TODO: add type for pad -> easier to tell button events apart in the handler
-            handler(board, CONTROL_TYPE_BUTTON, i, pinState);
-          }
-        }
-      }
-    }
+  const uint8_t inputEventCount = inputEvents.available();
+  for (uint8_t i = 0; i < inputEventCount; ++i) {
+    handleInputEvent(inputEvents.peek(i));
   }
+  inputEvents.consume(inputEventCount);
 #endif
 
+#if PCB_VERSION != 3 // TODO
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_POT)
-  for (int i = 0; i < BOARD_COUNT; ++i) {
+  {
+    PROFILE_SCOPE(profiler, PROFILE_SECTION_POTS);
+    for (int i = 0; i < BOARD_COUNT; ++i) {
       int position;
       uint8_t positionChanged = false;
 
-      if (BOARD_FEATURES[i] & BOARD_FEATURE_POT) {
+      if (BOARD_DESCRIPTORS[i].has(BOARD_FEATURE_POT)) {
         // Resolution restricted to 7-bits for MIDI compatibility
         position = analogRead(POT_PINS[i]) >> 3;
         positionChanged = position != positions[i] && (position == 0 || position == 127 || POT_CHANGE_THRESHOLD < abs(positions[i] - position));
@@ -224,72 +246,497 @@ void Slave_::update() {
 #endif // PCB_VERSION != 3
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
-  for (int i = 0; i < BOARD_COUNT; ++i) {
-    int position;
-    uint8_t positionChanged = false;
-    const int8_t directionMultiplier = (int8_t) ENCODER_DIRECTIONS[i];
-
-    if (BOARD_FEATURES[i] & BOARD_FEATURE_ENCODER) {
-      if (ENCODER_TYPES[i] == ENCODER_TYPE_ABSOLUTE) {
-        position = (*(encoders)[i]).getPosition() * directionMultiplier;
-        positionChanged = position != positions[i];
-      } else {
-        position = static_cast<int8_t>((*(encoders)[i]).getDirection()) * directionMultiplier;
-        positionChanged = position != 0;
+  {
+    PROFILE_SCOPE(profiler, PROFILE_SECTION_ENCODERS);
+    updateEncoders<0>();
+  }
+#endif
+
+  if ((uint16_t) ((uint16_t) millis() - lastDebugReportMillis) >= DEBUG_REPORT_INTERVAL_MILLIS) {
+    reportDebugCounters();
+  }
+
+#ifdef PROFILER_ENABLED
+  if (profileRequest) {
+    reportProfile();
+  }
+#endif
+
+  {
+    PROFILE_SCOPE(profiler, PROFILE_SECTION_TX);
+    flushMessagesToMaster();
+  }
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+  {
+    PROFILE_SCOPE(profiler, PROFILE_SECTION_LEDS);
+    // After the messages so that the frame does not wait for the LEDs
+    refreshLeds();
+  }
+#endif
+}
+
+// Sends the counters that changed since the last report. Called at most once per
+// DEBUG_REPORT_INTERVAL_MILLIS, so a congested or failing bus does not get a message for
+// every dropped event on top.
+void Slave_::reportDebugCounters() {
+  bool reported = false;
+#if HAS_INPUT_EVENTS
+  const uint16_t inputEventOverflows = inputEvents.getOverflowCount();
+  if (inputEventOverflows != reportedInputEventOverflows) {
+    reportedInputEventOverflows = inputEventOverflows;
+    sendMessageToMaster(DEBUG_INPUT_EVENTS_DROPPED, inputEventOverflows, CONTROL_TYPE_DEBUG);
+    reported = true;
+  }
+#endif
+  if (droppedMessages != reportedDroppedMessages) {
+    reportedDroppedMessages = droppedMessages;
+    sendMessageToMaster(DEBUG_MESSAGES_DROPPED, droppedMessages, CONTROL_TYPE_DEBUG);
+    reported = true;
+  }
+#ifdef WIRE_HAS_ERROR_COUNTS
+  WireErrorCounts i2cErrors;
+  Wire.getErrorCounts(i2cErrors);
+  if (i2cErrors.timeouts + i2cErrors.busErrors != reportedI2cErrors) {
+    reportedI2cErrors = i2cErrors.timeouts + i2cErrors.busErrors;
+    sendMessageToMaster(DEBUG_I2C_ERRORS, reportedI2cErrors, CONTROL_TYPE_DEBUG);
+    reported = true;
+  }
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+  if (buttonGlitches != reportedButtonGlitches) {
+    reportedButtonGlitches = buttonGlitches;
+    sendMessageToMaster(DEBUG_BUTTON_GLITCHES, buttonGlitches, CONTROL_TYPE_DEBUG);
+    reported = true;
+  }
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+  if (ledRefreshStats.deferredFrames != reportedLedRefreshStats.deferredFrames) {
+    sendMessageToMaster(DEBUG_LED_FRAMES_DEFERRED, ledRefreshStats.deferredFrames, CONTROL_TYPE_DEBUG);
+    reported = true;
+  }
+  if (ledRefreshStats.mergedFrames != reportedLedRefreshStats.mergedFrames) {
+    sendMessageToMaster(DEBUG_LED_FRAMES_MERGED, ledRefreshStats.mergedFrames, CONTROL_TYPE_DEBUG);
+    reported = true;
+  }
+  reportedLedRefreshStats = ledRefreshStats;
+#endif
+  if (reported) {
+    lastDebugReportMillis = millis();
+  }
+}
+
+#ifdef PROFILER_ENABLED
+// One section per update() pass and only while the outbox has room for it, so the answer
+// neither crowds out the input events nor blocks on the bus
+void Slave_::reportProfile() {
+  if (outbox.fifoSpace() < PROFILE_STAT_COUNT) {
+    return;
+  }
+  const ProfileSection section = (ProfileSection) reportedProfileSections;
+  const Profiler::Entry entry = profiler.read(section);
+  for (uint8_t stat = 0; stat < PROFILE_STAT_COUNT; ++stat) {
+    sendMessageToMaster(debugProfileInput(section, stat), Profiler::stat(entry, (ProfileStat) stat), CONTROL_TYPE_DEBUG);
+  }
+  if (++reportedProfileSections == PROFILE_SECTION_COUNT) {
+    reportedProfileSections = 0;
+    if (profileRequest & PROFILE_REQUEST_RESET) {
+      profiler.reset();
+    }
+    profileRequest = 0;
+  }
+}
+#endif
+
+#if HAS_INPUT_EVENTS
+void Slave_::pushInputEvent(InputSource source, uint8_t index, uint8_t states) {
+  InputEvent event;
+  event.source = source;
+  event.index = index;
+  event.states = states;
+  event.time = micros();
+  inputEvents.push(event);
+}
+
+inline void Slave_::handleInputEvent(const InputEvent& event) {
+  const uint32_t now = micros();
+  handlingEdge = true;
+  handledEdgeMicros = now - (uint16_t) ((uint16_t) now - event.time);
+  switch (event.source) {
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
+    case INPUT_SOURCE_SWITCH: {
+      PROFILE_SCOPE(profiler, PROFILE_SECTION_SWITCH_EVENTS);
+      handleSwitchStates(event.states);
+      break;
+    }
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH) && PCB_VERSION != 3 // TODO
+    case INPUT_SOURCE_TOUCH: {
+      PROFILE_SCOPE(profiler, PROFILE_SECTION_TOUCH);
+      handleTouchStates(event.states);
+      break;
+    }
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS) && PCB_VERSION != 3 // TODO
+    case INPUT_SOURCE_PAD: {
+      PROFILE_SCOPE(profiler, PROFILE_SECTION_PADS);
+      handlePadStates(event.index, event.states);
+      break;
+    }
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+    case INPUT_SOURCE_MATRIX: {
+      PROFILE_SCOPE(profiler, PROFILE_SECTION_MATRIX);
+      handleMatrixStates(event.index, event.states);
+      break;
+    }
+#endif
+    default:
+      break;
+  }
+  handlingEdge = false;
+}
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
+void Slave_::handleSwitchStates(uint8_t states) {
+  uint8_t changed = previousSwitchStates ^ states;
+  LOG(SLAVE_SWITCH_STATES, states, changed);
+  if (changed) {
+    previousSwitchStates = states;
+    #if PCB_VERSION == 3
+    for (uint8_t board = BOARD_L2; board <= BOARD_R2; ++board) {
+      if (changed & (1 << board) && boardSettings[board].features & BOARD_FEATURE_BUTTON) {
+        // getButtonStates() sets the bit of a pressed button
+        handler((Board)board, CONTROL_TYPE_BUTTON, 0, states & (1 << board) ? 1 : 0);
       }
+    }
+    #else
+    for (uint8_t i = BOARD_L1; i <= BOARD_R1; ++i) {
+      uint8_t switchMask = (1 << SW_INTS[i]);
+      if (changed & switchMask && boardSettings[i].features & BOARD_FEATURE_BUTTON) {
+        handler(i, CONTROL_TYPE_BUTTON, 0, (states & switchMask) ? 0 : 1);
+      }
+    }
+    #endif
+  }
+}
+#endif
 
-      #if defined(USART_DEBUG_ENABLED) && defined(INTERRUPT_DEBUG)
-      uint8_t stateA = digitalRead(ENCODER_PINS[i][0]);
-      uint8_t stateB = digitalRead(ENCODER_PINS[i][1]);
-
-      if (stateA != states[2*i] || stateB != states[2*i+1]) {
-        Serial.print("Int: ");
-        Serial.println(interrupter);
-        Serial.print("Pins ");
-        Serial.println(i);
-        Serial.println("A B");
-        Serial.print(stateA);
-        Serial.print(" ");
-        Serial.println(stateB);
-        states[2*i] = stateA;
-        states[2*i+1] = stateB;
+#if PCB_VERSION != 3 // TODO
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH)
+void Slave_::handleTouchStates(uint8_t states) {
+  uint8_t changed = previousTouchStates ^ states;
+  previousTouchStates = states;
+  LOG(SLAVE_TOUCH_STATES, states, changed);
+  // TODO:
+  if (changed) {
+    for (uint8_t i = 0; i < 3; ++i) {
+      uint8_t switchMask = (1 << SW_INTS[i]);
+      if (changed & switchMask) {
+        handler(i, CONTROL_TYPE_TOUCH, 0, (states & switchMask) ? 0 : 1);
       }
-      #endif
-    } else {
-      continue;
     }
+  }
+}
+#endif
 
-    if (positionChanged) {
-      if (ENCODER_TYPES[i] == ENCODER_TYPE_ABSOLUTE) {
-        int limited = 0;
-        if (ENCODER_LOOP[i]) {
-          limited = position > ENCODER_POSITION_LIMITS[i*2+1] ? ENCODER_POSITION_LIMITS[i*2] : position < ENCODER_POSITION_LIMITS[i*2] ? ENCODER_POSITION_LIMITS[i*2+1] : position;
-        } else {
-          limited = constrain(position, ENCODER_POSITION_LIMITS[i*2], ENCODER_POSITION_LIMITS[i*2+1]);
-        }
-        positions[i] = limited;
-        if (position != limited) {
-          (*(encoders)[i]).setPosition(limited * directionMultiplier);
-        }
-        handler((Board)i, CONTROL_TYPE_POSITION, 0, constrain(position, ENCODER_POSITION_LIMITS[i*2], ENCODER_POSITION_LIMITS[i*2+1]));
-      } else {
-        handler((Board)i, CONTROL_TYPE_ENCODER, 0, position);
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS)
+void Slave_::handlePadStates(uint8_t board, uint8_t states) {
+  const uint8_t padStateIndex = board - 1;
+  uint8_t changed = previousPadStates[padStateIndex] ^ states;
+  previousPadStates[padStateIndex] = states;
+  LOG(SLAVE_PAD_STATES, board, states, changed);
+  if (changed) {
+    for (uint8_t i = 0; i < 4; ++i) {
+      uint8_t padMask = (1 << i);
+      if (changed & padMask) {
+        uint8_t pinState = (states & padMask) ? 1 : 0;
+        // TODO: add type for pad -> easier to tell button events apart in the handler
+        handler(board, CONTROL_TYPE_BUTTON, i, pinState);
       }
     }
   }
+}
 #endif
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+// Every key has its own input, several keys can be held at once (needs a diode per key to avoid ghosting)
+void Slave_::handleMatrixStates(uint8_t index, uint8_t states) {
+  const uint8_t matrix = index / MATRIX_OUTPUTS;
+  const uint8_t row = index % MATRIX_OUTPUTS;
+  const uint8_t changed = previousMatrixButtonStates[matrix][row] ^ states;
+  previousMatrixButtonStates[matrix][row] = states;
+  for (uint8_t input = 0; input < MATRIX_INPUTS; ++input) {
+    if (changed & (1 << input)) {
+      // TODO: this will conflict with button on M / M1 & M2
+      // TODO: use MATRIX instead of BUTTON
+      handler((Board) MATRIX_BOARDS[matrix], CONTROL_TYPE_BUTTON, MATRIX_INPUTS * row + input, (states >> input) & 1);
+    }
+  }
 }
+#endif
 
 void Slave_::sendMessageToMaster(byte input, uint16_t value, ControlType type) {
-  SlaveToMasterMessage message = {address, input, type, value};
+  SlaveToMasterMessage message = {address, input, type, value, 0, false}; // The outbox stamps the time
   sendMessageToMaster(message);
 }
 
 void Slave_::sendMessageToMaster(SlaveToMasterMessage& message) {
-  Wire.beginTransmission(1);
-  byte data[] = {address, message.input, (byte)message.type, highByte(message.value), lowByte(message.value)};
-  Wire.write(data, SlaveToMasterMessageSize);
-  Wire.endTransmission();
+  // Encoder detents and input events carry the time of their pin edge or of the scan that pushed
+  // them, the rest is timestamped when update() hands it over
+  const uint16_t time = masterTime(handlingEdge ? handledEdgeMicros : micros());
+  if (outbox.push(message.input, message.value, message.type, time)) {
+    return;
+  }
+#ifndef MESSAGE_POLLING_ENABLED
+  // Wait for the previous frame to go out rather than dropping events, but not for a stuck bus
+  const uint32_t waitStart = micros();
+  while (Wire.transmitStatus() == WIRE_TRANSMIT_PENDING && micros() - waitStart < I2C_TIMEOUT_MICROS) {}
+#endif
+  flushMessagesToMaster();
+  // Only when the master does not take the frames (bus errors or not polling)
+  if (!outbox.push(message.input, message.value, message.type, time)) {
+    droppedMessages++;
+  }
+}
+
+uint16_t Slave_::masterTime(uint32_t localMicros) {
+  uint32_t offset;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    offset = masterClockOffset;
+  }
+  return (localMicros + offset) >> MESSAGE_TIME_SHIFT;
+}
+
+void Slave_::flushMessagesToMaster() {
+  if (outbox.isEmpty()) {
+    return;
+  }
+  // Every update() pass, messages waiting for a congested bus must not wrap
+  outbox.clampAges(masterTime(micros()));
+
+#ifdef MESSAGE_POLLING_ENABLED
+  if (readyMessagesLength != 0) {
+    return;
+  }
+  const uint8_t length = outbox.writeFrame(readyMessages, address, masterClockSynced, masterTime(micros()));
+  readySequence ^= POLL_SEQUENCE_BIT;
+  // Make sure the frame is written before it is published to handleMasterRequest()
+  __asm__ __volatile__("" ::: "memory");
+  readyMessagesLength = length;
+  outbox.consumeFrame();
+#else
+  // Keep collecting events while the previous frame is still on the bus
+  const uint8_t status = Wire.transmitStatus();
+  if (status == WIRE_TRANSMIT_PENDING) {
+    return;
+  }
+  if (frameInFlight) {
+    frameInFlight = false;
+    // NACK, lost arbitration or timeout: the next frame starts with the same messages
+    if (status == 0 || ++frameSendFailures == MESSAGE_FRAME_SEND_ATTEMPTS) {
+      if (status != 0) {
+        droppedMessages += outbox.frameEventCount();
+      }
+      outbox.consumeFrame();
+      frameSendFailures = 0;
+    }
+    if (outbox.isEmpty()) {
+      return;
+    }
+  }
+  uint8_t frame[MESSAGE_FRAME_MAX_SIZE];
+  const uint8_t length = outbox.writeFrame(frame, address, masterClockSynced, masterTime(micros()));
+  Wire.beginTransmission(MASTER_ADDRESS);
+  Wire.write(frame, length);
+  frameInFlight = Wire.endTransmissionAsync() == 0;
+#endif
+}
+
+#ifdef MESSAGE_POLLING_ENABLED
+// Called from the TWI interrupt when the master polls this slave. The frame stays until the
+// master acknowledges it, see POLL_ACK_COMMAND.
+void Slave_::handleMasterRequest() {
+  const uint8_t length = readyMessagesLength;
+  if (frameRequested && length != 0) {
+    Wire.write(readyMessages, length);
+  } else {
+    Wire.write(length == 0 ? (uint8_t) 0 : (uint8_t) (length | readySequence));
+  }
+  frameRequested = false;
+}
+
+void onMasterRequest() {
+  Slave.handleMasterRequest();
+}
+#endif
+
+void Slave_::handleMasterWrite(int length) {
+  if (length == TIME_SYNC_SIZE && Wire.peek() == TIME_SYNC_COMMAND) {
+    const uint32_t now = micros();
+    uint8_t sync[TIME_SYNC_SIZE];
+    for (uint8_t i = 0; i < TIME_SYNC_SIZE; ++i) {
+      sync[i] = Wire.read();
+    }
+    masterClockOffset = readTimeSync(sync) + TIME_SYNC_TRANSFER_MICROS - now;
+    masterClockSynced = true;
+    return;
+  }
+#ifdef MESSAGE_POLLING_ENABLED
+  if (length == 1 && (Wire.peek() == POLL_LENGTH_COMMAND || Wire.peek() == POLL_FRAME_COMMAND)) {
+    frameRequested = Wire.read() == POLL_FRAME_COMMAND;
+    return;
+  }
+  if (length == POLL_ACK_SIZE && Wire.peek() == POLL_ACK_COMMAND) {
+    Wire.read();
+    const uint8_t acknowledged = Wire.read();
+    if (readyMessagesLength != 0 && acknowledged == (readyMessagesLength | readySequence)) {
+      readyMessagesLength = 0;
+    }
+    return;
+  }
+#endif
+#ifdef PROFILER_ENABLED
+  // A request is answered before the next one is taken
+  if (length == PROFILE_REQUEST_SIZE && Wire.peek() == PROFILE_REQUEST_COMMAND) {
+    Wire.read();
+    const uint8_t flags = Wire.read();
+    if (!profileRequest) {
+      profileRequest = PROFILE_REQUEST_PENDING | flags;
+    }
+    return;
+  }
+#endif
+  // A config that has not been stored yet is not overwritten
+  if (length < 1 || Wire.read() != BOARD_CONFIG_COMMAND || receivedBoardConfigLength) {
+    return;
+  }
+  uint8_t received = 0;
+  while (Wire.available() && received < BOARD_CONFIG_MAX_SIZE) {
+    receivedBoardConfig[received++] = Wire.read();
+  }
+  receivedBoardConfigLength = received;
+}
+
+void onMasterReceive(int length) {
+  Slave.handleMasterWrite(length);
+}
+
+// Falls back to the BOARD_DESCRIPTORS defaults when the EEPROM does not have a valid config
+inline void Slave_::loadBoardConfig() {
+  uint8_t config[BOARD_CONFIG_MAX_SIZE];
+  const uint8_t length = boardConfigSize(BOARD_COUNT);
+  for (uint8_t i = 0; i < length; ++i) {
+    config[i] = EEPROM.read(BOARD_CONFIG_EEPROM_ADDRESS + i);
+  }
+  if (!isValidBoardConfig(config, length, BOARD_COUNT)) {
+    writeDefaultBoardConfig(config);
+  }
+  applyBoardConfig(config);
+}
+
+uint8_t Slave_::writeDefaultBoardConfig(uint8_t* config) {
+  const uint8_t length = boardConfigSize(BOARD_COUNT);
+  config[0] = BOARD_CONFIG_VERSION;
+  config[1] = BOARD_COUNT;
+  for (uint8_t i = 0; i < BOARD_COUNT; ++i) {
+    const BoardDescriptor& board = BOARD_DESCRIPTORS[i];
+    uint8_t* boardConfig = config + BOARD_CONFIG_HEADER_SIZE + i * BOARD_CONFIG_BOARD_SIZE;
+    boardConfig[0] = board.features;
+    boardConfig[1] = (board.encoderType == ENCODER_TYPE_RELATIVE ? BOARD_CONFIG_FLAG_RELATIVE : 0) |
+      (board.encoderDirection == ENCODE_DIRECTION_CCW ? BOARD_CONFIG_FLAG_CCW : 0) |
+      (board.loopPosition ? BOARD_CONFIG_FLAG_LOOP : 0);
+    boardConfig[2] = board.minPosition;
+    boardConfig[3] = board.maxPosition;
+  }
+  config[length - 1] = boardConfigChecksum(config, length);
+  return length;
+}
+
+// Expects a valid config
+void Slave_::applyBoardConfig(const uint8_t* config) {
+  for (uint8_t i = 0; i < BOARD_COUNT; ++i) {
+    const uint8_t* boardConfig = config + BOARD_CONFIG_HEADER_SIZE + i * BOARD_CONFIG_BOARD_SIZE;
+    const uint8_t flags = boardConfig[1];
+    BoardSettings& settings = boardSettings[i];
+    settings.features = BOARD_DESCRIPTORS[i].features & boardConfig[0];
+    settings.encoderMode = !(settings.features & BOARD_FEATURE_ENCODER) ? ENCODER_MODE_DISABLED :
+      flags & BOARD_CONFIG_FLAG_RELATIVE ? ENCODER_MODE_RELATIVE :
+      flags & BOARD_CONFIG_FLAG_LOOP ? ENCODER_MODE_LOOPED : ENCODER_MODE_CLAMPED;
+    settings.encoderDirection = flags & BOARD_CONFIG_FLAG_CCW ? -1 : 1;
+    settings.minPosition = boardConfig[2];
+    settings.maxPosition = max(boardConfig[2], boardConfig[3]);
+  }
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+  // A chain is shared by two boards, it stays lit while one of them has the LEDs on
+  enabledLedChains = 0;
+  for (uint8_t i = 0; i < BOARD_COUNT; ++i) {
+    if (boardSettings[i].features & BOARD_FEATURE_LED) {
+      enabledLedChains |= 1 << ledChainForBoard((Board) i);
+    }
+  }
+  for (uint8_t i = 0; i < BOARD_COUNT; ++i) {
+    if (!(enabledLedChains & (1 << ledChainForBoard((Board) i)))) {
+      fillLeds((Board) i, 0);
+    }
+  }
+#endif
+}
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+// After a config change the encoders start over from where they are: a relative encoder drops the
+// detents turned before, an absolute one sends its position in the new direction and limits at once.
+void Slave_::syncEncoderPositions() {
+  for (uint8_t i = 0; i < BOARD_COUNT; ++i) {
+    const BoardSettings& settings = boardSettings[i];
+    if (!BOARD_DESCRIPTORS[i].has(BOARD_FEATURE_ENCODER) || settings.encoderMode == ENCODER_MODE_DISABLED) {
+      continue;
+    }
+    if (settings.encoderMode == ENCODER_MODE_RELATIVE) {
+#if PCB_VERSION == 3
+      encoder(i).takeDelta(INT16_MAX);
+#endif
+      positions[i] = encoder(i).getPosition();
+      continue;
+    }
+    const int position = encoder(i).getPosition() * settings.encoderDirection;
+    const int limited = constrain(position, settings.minPosition, settings.maxPosition);
+    if (position != limited) {
+      encoder(i).setPosition(limited * settings.encoderDirection);
+    }
+    positions[i] = limited;
+    handler((Board) i, CONTROL_TYPE_POSITION, 0, limited);
+  }
+}
+#endif
+
+// Called every update() pass while a config is pending. An EEPROM byte takes ~3.3 ms to write,
+// so each pass starts at most one write and only when the previous one is done. The config is
+// applied once it is all stored.
+void Slave_::storeReceivedBoardConfig() {
+  const uint8_t length = receivedBoardConfigLength;
+  if (storedBoardConfigBytes == 0 && !isValidBoardConfig(receivedBoardConfig, length, BOARD_COUNT)) {
+    receivedBoardConfigLength = 0;
+    sendMessageToMaster(DEBUG_BOARD_CONFIG, 0, CONTROL_TYPE_DEBUG);
+    return;
+  }
+  if (storedBoardConfigBytes < length) {
+    if (eeprom_is_ready()) {
+      EEPROM.update(BOARD_CONFIG_EEPROM_ADDRESS + storedBoardConfigBytes, receivedBoardConfig[storedBoardConfigBytes]);
+      storedBoardConfigBytes++;
+    }
+    return;
+  }
+  applyBoardConfig(receivedBoardConfig);
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+  syncEncoderPositions();
+#endif
+  storedBoardConfigBytes = 0;
+  receivedBoardConfigLength = 0;
+  sendMessageToMaster(DEBUG_BOARD_CONFIG, BOARD_CONFIG_VERSION, CONTROL_TYPE_DEBUG);
 }
 
 void Slave_::toggleBuiltinLed() {
@@ -298,9 +745,30 @@ void Slave_::toggleBuiltinLed() {
 #endif
 }
 
+#if PCB_VERSION != 3
 void Slave_::tickEncoder(Board board) {
-  (*(encoders)[board]).tick();
+  encoder(board).tick();
 }
+#endif
+
+#ifdef ENCODER_ACCELERATION_ENABLED
+uint8_t Slave_::encoderAccelerationFactor(uint8_t board, int delta) {
+  if (delta == 0) {
+    return 1;
+  }
+
+  const uint16_t now = millis();
+  const uint16_t millisPerDetent = (uint16_t) (now - lastEncoderChangeMillis[board]) / abs(delta);
+  lastEncoderChangeMillis[board] = now;
+
+  for (uint8_t i = 0; i < sizeof(ENCODER_ACCELERATION_INTERVALS); ++i) {
+    if (millisPerDetent <= ENCODER_ACCELERATION_INTERVALS[i]) {
+      return ENCODER_ACCELERATION_FACTORS[i];
+    }
+  }
+  return 1;
+}
+#endif
 
 int Slave_::getPosition(Board board) {
   return positions[board];
@@ -309,77 +777,77 @@ int Slave_::getPosition(Board board) {
 inline void Slave_::setupInterrupts() {
   PCICR |= (1 << PCIE0) | (1 << PCIE1) | (1 << PCIE2);
 
-  if (BOARD_FEATURES[BOARD_L1] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_L1].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENCL1A);
     enablePCINT(ENCL1B);
   }
 
-  if (BOARD_FEATURES[BOARD_L2] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_L2].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENCL2A);
     enablePCINT(ENCL2B);
   }
 
 #if PCB_VERSION == 3
-  if (BOARD_FEATURES[BOARD_M1] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_M1].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENCM1B);
     enablePCINT(ENCM1A);
   }
-  if (BOARD_FEATURES[BOARD_M2] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_M2].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENCM2B);
     enablePCINT(ENCM2A);
   }
 #else
-  if (BOARD_FEATURES[BOARD_M] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_M].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENC1B);
     enablePCINT(ENC1A);
   }
 #endif
 
-  if (BOARD_FEATURES[BOARD_R1] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_R1].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENCR1A);
     enablePCINT(ENCR1B);
   }
 
-  if (BOARD_FEATURES[BOARD_R2] & BOARD_FEATURE_ENCODER) {
+  if (BOARD_DESCRIPTORS[BOARD_R2].has(BOARD_FEATURE_ENCODER)) {
     enablePCINT(ENCR2A);
     enablePCINT(ENCR2B);
   }
 
 #if PCB_VERSION != 3 // v3 does not have a PCINT on SWL :(
-  if (BOARD_FEATURES[BOARD_L1] & (BOARD_FEATURE_BUTTON | BOARD_FEATURE_TOUCH)) {
+  if (BOARD_DESCRIPTORS[BOARD_L1].has(BOARD_FEATURE_BUTTON | BOARD_FEATURE_TOUCH)) {
     enablePCINT(SWL);
   }
 #endif
 
 #if PCB_VERSION != 3 // v3 does not have a PCINT on SWM :(
-  if (BOARD_FEATURES[BOARD_M] & BOARD_FEATURE_BUTTON) {
+  if (BOARD_DESCRIPTORS[BOARD_M].has(BOARD_FEATURE_BUTTON)) {
     enablePCINT(SWM);
   }
-  if (BOARD_FEATURES[BOARD_M] & BOARD_FEATURE_TOUCH) {
+  if (BOARD_DESCRIPTORS[BOARD_M].has(BOARD_FEATURE_TOUCH)) {
     enablePCINT(TOUCH);
   }
 #endif
 
-if (BOARD_FEATURES[BOARD_R1] & (BOARD_FEATURE_BUTTON | BOARD_FEATURE_TOUCH)) {
+if (BOARD_DESCRIPTORS[BOARD_R1].has(BOARD_FEATURE_BUTTON | BOARD_FEATURE_TOUCH)) {
   enablePCINT(SWR);
 }
 
 #if PCB_VERSION != 3 // TODO
-  if (BOARD_FEATURES[BOARD_L1] & BOARD_FEATURE_PADS) {
+  if (BOARD_DESCRIPTORS[BOARD_L1].has(BOARD_FEATURE_PADS)) {
     enablePCINT(SWL);
     enablePCINT(ENCL1A);
     enablePCINT(ENCL1B);
     enablePCINT(ENCL2A);
   }
 
-  if (BOARD_FEATURES[BOARD_M] & BOARD_FEATURE_PADS) {
+  if (BOARD_DESCRIPTORS[BOARD_M].has(BOARD_FEATURE_PADS)) {
     enablePCINT(SWM);
     enablePCINT(ENC1B);
     enablePCINT(ENC1A);
     enablePCINT(TOUCH); // TODO: fix  POT -> TOUCH on board
   }
 
-  if (BOARD_FEATURES[BOARD_R1] & BOARD_FEATURE_PADS) {
+  if (BOARD_DESCRIPTORS[BOARD_R1].has(BOARD_FEATURE_PADS)) {
     enablePCINT(ENCR1A);
     enablePCINT(ENCR1B);
     enablePCINT(ENCR2A);
@@ -388,33 +856,103 @@ if (BOARD_FEATURES[BOARD_R1] & (BOARD_FEATURE_BUTTON | BOARD_FEATURE_TOUCH)) {
 #endif
 }
 
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+// Replaces analogRead() on the button pins: each finished conversion starts the next one in
+// handleButtonSample(), so a ladder gets a new sample every ~104 us times the enabled ladders.
+inline void Slave_::setupButtonSampling() {
+  while (!BUTTON_LADDER_ENABLED[sampledButtonLadder]) {
+    ++sampledButtonLadder;
+  }
+  ADMUX = _BV(REFS0) | BUTTON_LADDER_CHANNELS[sampledButtonLadder];
+  // 8 MHz / 64 = 125 kHz ADC clock, 13 clocks per conversion
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADSC);
+}
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+// Indexed with digitalPinToPort(pin) - PB
+static volatile uint8_t* const MATRIX_PORT_OUTPUTS[] = {&PORTB, &PORTC, &PORTD};
+
+// Timer2 in CTC mode calls scanMatrices() every MATRIX_SCAN_MICROS. Expects the pins to be set up
+// by setupPinModes().
+inline void Slave_::setupMatrixScanner() {
+  for (uint8_t matrix = 0; matrix < MAX_MATRIX_BOARD_COUNT; ++matrix) {
+    for (uint8_t input = 0; input < MATRIX_INPUTS; ++input) {
+      const uint8_t pin = BUTTON_MATRIX_INPUT_PINS[matrix][input];
+      const uint8_t port = digitalPinToPort(pin);
+      // Pins without a digital port (SWL on v3, TODO) get an empty mask and never read as pressed
+      matrixInputPorts[matrix][input] = port == NOT_A_PORT ? 0 : port - PB;
+      matrixInputMasks[matrix][input] = port == NOT_A_PORT ? 0 : digitalPinToBitMask(pin);
+    }
+    for (uint8_t output = 0; output < MATRIX_OUTPUTS; ++output) {
+      const uint8_t pin = BUTTON_MATRIX_OUTPUT_PINS[matrix][output];
+      const uint8_t port = digitalPinToPort(pin);
+      matrixOutputPorts[matrix][output] = port == NOT_A_PORT ? 0 : port - PB;
+      matrixOutputMasks[matrix][output] = port == NOT_A_PORT ? 0 : digitalPinToBitMask(pin);
+    }
+  }
+
+  // 8 MHz / 64 = 125 kHz, 8 µs per timer count
+  static_assert(MATRIX_SCAN_MICROS * (F_CPU / 64) / 1000000 <= 256, "MATRIX_SCAN_MICROS does not fit Timer2");
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  OCR2A = MATRIX_SCAN_MICROS * (F_CPU / 64) / 1000000 - 1;
+  TIMSK2 = _BV(OCIE2A);
+}
+
+void Slave_::scanMatrices() {
+  for (uint8_t matrix = 0; matrix < MAX_MATRIX_BOARD_COUNT; ++matrix) {
+    if (!MATRIX_ENABLED[matrix]) {
+      continue;
+    }
+    for (uint8_t row = 0; row < MATRIX_OUTPUTS; ++row) {
+      volatile uint8_t* const output = MATRIX_PORT_OUTPUTS[matrixOutputPorts[matrix][row]];
+      *output &= ~matrixOutputMasks[matrix][row];
+      _delay_us(MATRIX_SETTLE_MICROS);
+      const uint8_t portPins[] = {PINB, PINC, PIND};
+      *output |= matrixOutputMasks[matrix][row];
+
+      uint8_t states = 0;
+      for (uint8_t input = 0; input < MATRIX_INPUTS; ++input) {
+        if (~portPins[matrixInputPorts[matrix][input]] & matrixInputMasks[matrix][input]) { // Pressed keys pull the input low
+          states |= 1 << input;
+        }
+      }
+      if (states != matrixRowStates[matrix][row]) {
+        matrixRowStates[matrix][row] = states;
+        pushInputEvent(INPUT_SOURCE_MATRIX, matrix * MATRIX_OUTPUTS + row, states);
+      }
+    }
+  }
+}
+#endif
+
 inline void Slave_::setupPinModes() {
   for (uint8_t i = 0; i < BOARD_COUNT; ++i) {
-    const uint8_t boardFeatures = BOARD_FEATURES[i];
+    const BoardDescriptor& board = BOARD_DESCRIPTORS[i];
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
-    if (boardFeatures & BOARD_FEATURE_ENCODER) {
+    if (board.has(BOARD_FEATURE_ENCODER)) {
       pinMode(ENCODER_PINS[i][0], INPUT_PULLUP);
       pinMode(ENCODER_PINS[i][1], INPUT_PULLUP);
     }
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
-    if (boardFeatures & BOARD_FEATURE_MATRIX) {
+    if (board.has(BOARD_FEATURE_MATRIX)) {
       for (uint8_t output = 0; output < MATRIX_OUTPUTS; ++output) {
         uint8_t pin = BUTTON_MATRIX_OUTPUT_PINS[BOARD_MATRIX_INDEX(i)][output];
         pinMode(pin, OUTPUT);
         digitalWrite(pin, HIGH);
       }
       for (uint8_t input = 0; input < MATRIX_INPUTS; ++input) {
-        sendMessageToMaster(DEBUG_BOOT + 2, BOARD_MATRIX_INDEX(i), input);
         pinMode(BUTTON_MATRIX_INPUT_PINS[BOARD_MATRIX_INDEX(i)][input], INPUT_PULLUP);
       }
     }
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
-    if (boardFeatures & BOARD_FEATURE_BUTTON) {
+    if (board.has(BOARD_FEATURE_BUTTON)) {
 #if PCB_VERSION == 3
       pinMode(BUTTON_PINS[i], INPUT);
 #else
@@ -424,14 +962,14 @@ inline void Slave_::setupPinModes() {
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_POT)
-    if (boardFeatures & BOARD_FEATURE_POT) {
+    if (board.has(BOARD_FEATURE_POT)) {
       // TODO: anything needed here?
     }
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH)
 #if PCB_VERSION != 3 // TODO
-    if (boardFeatures & BOARD_FEATURE_TOUCH) {
+    if (board.has(BOARD_FEATURE_TOUCH)) {
       pinMode(TOUCH_PINS[i], INPUT);
     }
 #endif
@@ -439,12 +977,9 @@ inline void Slave_::setupPinModes() {
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS)
 #if PCB_VERSION != 3 // TODO
-    if (BOARD_FEATURES[i] & BOARD_FEATURE_PADS) {
+    if (board.has(BOARD_FEATURE_PADS)) {
       for (uint8_t j = 0; j < 4; ++j) {
-        #ifdef USART_DEBUG_ENABLED
-        Serial.print("Configuring pin as input: ");
-        Serial.println(PAD_PINS[i][j]);
-        #endif
+        LOG(SLAVE_PAD_PIN_INPUT, PAD_PINS[i][j]);
         pinMode(PAD_PINS[i][j], INPUT_PULLUP);
       }
     }
@@ -453,86 +988,132 @@ inline void Slave_::setupPinModes() {
   }
 }
 
-inline uint8_t Slave_::requestAddress() {
-  Wire.requestFrom(MASTER_ADDRESS, ADDRESS_LENGTH);
-  uint8_t receivedAddress = 255;
+// Asks until the master answers with an address for the unique id of this board
+uint8_t Slave_::requestAddress() {
+  uint8_t uniqueId[UNIQUE_ID_SIZE];
+  loadUniqueId(uniqueId);
+  // Boards that collided wait for different times
+  randomSeed(uniqueId[0] | (uniqueId[1] << 8) | ((uint32_t) uniqueId[2] << 16) | ((uint32_t) uniqueId[3] << 24));
+
+  uint8_t failures = 0;
+  while (true) {
+    Wire.beginTransmission(MASTER_ADDRESS);
+    Wire.write(ADDRESS_REQUEST_COMMAND);
+    Wire.write(uniqueId, UNIQUE_ID_SIZE);
+    // Repeated start: no other slave gets the bus before the answer
+    if (Wire.endTransmission(false) == 0 && Wire.requestFrom(MASTER_ADDRESS, ADDRESS_RESPONSE_SIZE) == ADDRESS_RESPONSE_SIZE) {
+      uint8_t response[ADDRESS_RESPONSE_SIZE];
+      for (uint8_t i = 0; i < ADDRESS_RESPONSE_SIZE; ++i) {
+        response[i] = Wire.read();
+      }
+      const uint8_t receivedAddress = response[UNIQUE_ID_SIZE];
+      if (memcmp(response, uniqueId, UNIQUE_ID_SIZE) == 0 && isValidSlaveAddress(receivedAddress)) {
+        LOG(SLAVE_RECEIVED_ADDRESS, receivedAddress);
+        return receivedAddress;
+      }
+    }
 
-  while (!Wire.available()) {}
+    LOG(SLAVE_NO_ADDRESS, failures + 1);
+    delay(1 + random(addressRequestBackoffMillis(failures)));
+    if (failures < 255) {
+      failures++;
+    }
+  }
+}
 
-  receivedAddress = Wire.read();
-  #ifdef USART_DEBUG_ENABLED
-  Serial.print("Got addr: ");
-  Serial.println(receivedAddress);
-  #endif
+inline void Slave_::loadUniqueId(uint8_t* uniqueId) {
+  bool erased = true;
+  for (uint8_t i = 0; i < UNIQUE_ID_SIZE; ++i) {
+    uniqueId[i] = EEPROM.read(UNIQUE_ID_EEPROM_ADDRESS + i);
+    erased = erased && uniqueId[i] == 0xFF;
+  }
+  if (!erased) {
+    return;
+  }
 
-  if (receivedAddress == 255) {
-    #ifdef USART_DEBUG_ENABLED
-    Serial.println("Did not get addr. Reset.");
-    #endif
-    delay(1000);
-    reset();
+  const uint32_t id = generateUniqueId();
+  for (uint8_t i = 0; i < UNIQUE_ID_SIZE; ++i) {
+    uniqueId[i] = id >> (8 * i);
   }
+  uniqueId[0] &= 0x7F; // Never erased
+  for (uint8_t i = 0; i < UNIQUE_ID_SIZE; ++i) {
+    EEPROM.update(UNIQUE_ID_EEPROM_ADDRESS + i, uniqueId[i]);
+  }
+}
 
-  return receivedAddress;
+// Counts busy loops over watchdog periods: the watchdog RC oscillator runs at a slightly
+// different rate on every chip and jitters against the crystal. Takes ~250 ms, on the first boot only.
+uint32_t Slave_::generateUniqueId() {
+  uint32_t id = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Interrupt mode with the interrupts off: the 16 ms timeouts only set WDIF
+    WDTCSR = _BV(WDIF) | _BV(WDIE);
+    for (uint8_t period = 0; period < UNIQUE_ID_WATCHDOG_PERIODS; ++period) {
+      uint16_t loops = 0;
+      while (!(WDTCSR & _BV(WDIF)) && ++loops) {}
+      WDTCSR = _BV(WDIF) | _BV(WDIE);
+      id = (id << 5 | id >> 27) ^ loops;
+    }
+    WDTCSR = _BV(WDIF);
+  }
+  return id;
 }
 
 inline void Slave_::setupI2c() {
   address = EEPROM.read(0);
-  #ifdef USART_DEBUG_ENABLED
-  Serial.println("Boot");
-  Serial.print("A: ");
-  Serial.println(address);
-  #endif
+  LOG(SLAVE_BOOT, address);
 
- if (address == 255 || address <= MASTER_ADDRESS) {
-    #ifdef USART_DEBUG_ENABLED
-    Serial.println("Req addr from master");
-    #endif
+  if (!isValidSlaveAddress(address)) {
+    LOG(SLAVE_REQUEST_ADDRESS);
     Wire.begin();
+    configureWire();
     address = requestAddress();
-
-    #ifdef USART_DEBUG_ENABLED
-    Serial.print("Start w/ addr: ");
-    Serial.println(address);
-    #endif
     Wire.begin(address);
+    configureWire();
 
     EEPROM.write(0, address);
-
-    delay(900);
     sendMessageToMaster(DEBUG_RECEIVED_ADDRESS, address, CONTROL_TYPE_DEBUG);
   } else {
     Wire.begin(address);
+    configureWire();
     sendMessageToMaster(DEBUG_BOOT, 1, CONTROL_TYPE_DEBUG);
   }
 
-  #ifdef USART_DEBUG_ENABLED
-  Serial.println("Done");
+  #ifdef MESSAGE_POLLING_ENABLED
+  Wire.onRequest(onMasterRequest);
   #endif
+  Wire.onReceive(onMasterReceive);
+
+  LOG(SLAVE_I2C_READY, address);
+}
+
+// Wire.begin() resets the clock to 100 kHz
+inline void Slave_::configureWire() {
+  Wire.setClock(I2C_CLOCK_HZ);
+#ifdef WIRE_HAS_GENERAL_CALL
+  // Time syncs
+  Wire.setGeneralCall(true);
+#endif
+#ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout(I2C_TIMEOUT_MICROS, true);
+#endif
 }
 
 #if PCB_VERSION != 3 // TODO
 inline uint8_t Slave_::readPadPin(uint8_t board, uint8_t pin) {
-  #ifdef USART_DEBUG_ENABLED
-  Serial.print("Read: ");
-  Serial.println(PAD_PINS[board][pin]);
-  Serial.print("Val: ");
-  Serial.println(digitalRead(PAD_PINS[board][pin]));
-  #endif
+  LOG(SLAVE_PAD_PIN_READ, PAD_PINS[board][pin], digitalRead(PAD_PINS[board][pin]));
   return (digitalRead(PAD_PINS[board][pin]) == LOW ? 0 : 1) << pin;
 }
 
 inline void Slave_::updatePadStates() {
   for (uint8_t board = 1; board < 4; ++board) { // Pads and buttons not available on leftmost and rightmost boards
-    if (BOARD_FEATURES[board] & BOARD_FEATURE_PADS) {
+    if (BOARD_DESCRIPTORS[board].has(BOARD_FEATURE_PADS)) {
       const uint8_t padStateIndex = board - 1;
-      padStates[padStateIndex] = readPadPin(board, 3) | readPadPin(board, 2) | readPadPin(board, 1) | readPadPin(board, 0);
-      #ifdef USART_DEBUG_ENABLED
-      Serial.print("BOARD PADS ");
-      Serial.println(board);
-      Serial.print("States: ");
-      Serial.println(padStates[padStateIndex]);
-      #endif
+      const uint8_t states = readPadPin(board, 3) | readPadPin(board, 2) | readPadPin(board, 1) | readPadPin(board, 0);
+      if (states != padStates[padStateIndex]) {
+        padStates[padStateIndex] = states;
+        pushInputEvent(INPUT_SOURCE_PAD, board, states);
+      }
     }
   }
 }
@@ -541,57 +1122,93 @@ inline void Slave_::updatePadStates() {
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
 void Slave_::updateSwitchStates() { // TODO: this is not called when the second button goes down because the logical state of the pin does not change
 #if PCB_VERSION == 3
-  switchStates = getButtonStates();
+  const uint8_t states = getButtonStates();
 #else
-  switchStates = SWITCH_PORT &
-    ((!!(BOARD_FEATURES[BOARD_L1] & BOARD_FEATURE_BUTTON) << SW_INTS[BOARD_L1]) |
-    (!!(BOARD_FEATURES[BOARD_M] & BOARD_FEATURE_BUTTON) << SW_INTS[BOARD_M]) |
-    (!!(BOARD_FEATURES[BOARD_R1] & BOARD_FEATURE_BUTTON) << SW_INTS[BOARD_R1]));
+  const uint8_t states = SWITCH_PORT &
+    ((BOARD_DESCRIPTORS[BOARD_L1].has(BOARD_FEATURE_BUTTON) << SW_INTS[BOARD_L1]) |
+    (BOARD_DESCRIPTORS[BOARD_M].has(BOARD_FEATURE_BUTTON) << SW_INTS[BOARD_M]) |
+    (BOARD_DESCRIPTORS[BOARD_R1].has(BOARD_FEATURE_BUTTON) << SW_INTS[BOARD_R1]));
 #endif
+  if (states != switchStates) {
+    switchStates = states;
+#if PCB_VERSION == 3 && ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+    // Called from update() here, keep the matrix scanner interrupt from pushing at the same time
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      pushInputEvent(INPUT_SOURCE_SWITCH, 0, states);
+    }
+#else
+    pushInputEvent(INPUT_SOURCE_SWITCH, 0, states);
+#endif
+  }
 }
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH)
 #if PCB_VERSION != 3 // TODO
 void Slave_::updateTouchStates() {
+  uint8_t states = touchStates;
   for (uint8_t i = 1; i < 4; ++i) { // Pads and buttons not available on leftmost and rightmost boards
-    if (BOARD_FEATURES[i] & BOARD_FEATURE_TOUCH) {
-      touchStates |= TOUCH_PINS[i];
+    if (BOARD_DESCRIPTORS[i].has(BOARD_FEATURE_TOUCH)) {
+      states |= TOUCH_PINS[i];
     }
   }
+  if (states != touchStates) {
+    touchStates = states;
+    pushInputEvent(INPUT_SOURCE_TOUCH, 0, states);
+  }
 }
 #endif
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
-ButtonPairStates Slave_::voltageToButtonStates(int voltage) {
-  ButtonPairStates buttonStates;
-  bool bothButtonsPressed = isInRange(voltage, BOTH_BUTTONS_VOLTAGE, BUTTON_VOLTAGE_RANGE);
-  buttonStates.firstButtonState = bothButtonsPressed || isInRange(voltage, FIRST_BUTTON_VOLTAGE, BUTTON_VOLTAGE_RANGE);
-  buttonStates.secondButtonState = bothButtonsPressed || isInRange(voltage, SECOND_BUTTON_VOLTAGE, BUTTON_VOLTAGE_RANGE);
-  return buttonStates;
+uint8_t Slave_::voltageToButtonStates(int voltage, uint8_t stableStates) {
+  if (stableStates && isInRange(voltage, BUTTON_STATE_VOLTAGES[stableStates], BUTTON_VOLTAGE_RANGE + BUTTON_VOLTAGE_HYSTERESIS)) {
+    return stableStates;
+  }
+  for (uint8_t states = 1; states < sizeof(BUTTON_STATE_VOLTAGES) / sizeof(BUTTON_STATE_VOLTAGES[0]); ++states) {
+    if (isInRange(voltage, BUTTON_STATE_VOLTAGES[states], BUTTON_VOLTAGE_RANGE)) {
+      return states;
+    }
+  }
+  return 0;
+}
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+// While a button goes down or up the ladder voltage passes through the windows of the other
+// states. Those only last for a sample or two and are counted as glitches instead of reported.
+uint8_t Slave_::debounceButtonLadder(ButtonLadderState& ladder, int voltage, uint16_t now) {
+  const uint8_t states = voltageToButtonStates(voltage, ladder.stableStates);
+  if (states != ladder.candidateStates) {
+    if (ladder.candidateStates != ladder.stableStates) {
+      buttonGlitches++;
+    }
+    ladder.candidateStates = states;
+    ladder.candidateSinceMillis = now;
+  } else if (states != ladder.stableStates && (uint16_t) (now - ladder.candidateSinceMillis) >= BUTTON_SETTLE_MILLIS) {
+    ladder.stableStates = states;
+  }
+  return ladder.stableStates;
 }
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
 uint8_t Slave_::getButtonStates() {
 #if PCB_VERSION == 3
+  // Debounces the latest samples of the ADC interrupt, bits 2 * ladder and 2 * ladder + 1
+  const uint16_t now = millis();
   uint8_t buttonStates = 0;
-#if HAS_FEATURE(L1, BOARD_FEATURE_BUTTON) || HAS_FEATURE(L2, BOARD_FEATURE_BUTTON)
-  int swlVoltage = analogRead(SWL);
-  ButtonPairStates lButtonStates = voltageToButtonStates(swlVoltage);
-  buttonStates |= ((lButtonStates.firstButtonState ? 1 : 0) | ((lButtonStates.secondButtonState ? 1 : 0) << 1));
-#endif
-#if HAS_FEATURE(M1, BOARD_FEATURE_BUTTON) || HAS_FEATURE(M2, BOARD_FEATURE_BUTTON)
-  int swmVoltage = analogRead(SWM);
-  ButtonPairStates mButtonStates = voltageToButtonStates(swmVoltage);
-  buttonStates |= (((mButtonStates.firstButtonState ? 1 : 0) << 2) | ((mButtonStates.secondButtonState ? 1 : 0) << 3)); // TODO: only take the buttons into account if they are enabled
-#endif
-#if HAS_FEATURE(R1, BOARD_FEATURE_BUTTON) || HAS_FEATURE(R2, BOARD_FEATURE_BUTTON)
-  int swrVoltage = analogRead(SWR);
-  ButtonPairStates rButtonStates = voltageToButtonStates(swrVoltage);
-  buttonStates |= (((rButtonStates.firstButtonState ? 1 : 0) << 4) | ((rButtonStates.secondButtonState ? 1 : 0) << 5));
-#endif
+  for (uint8_t ladder = 0; ladder < BUTTON_LADDER_COUNT; ++ladder) {
+    if (!BUTTON_LADDER_ENABLED[ladder]) {
+      continue;
+    }
+    int voltage;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      voltage = buttonSamples[ladder];
+    }
+    // TODO: only take the buttons into account if they are enabled
+    buttonStates |= debounceButtonLadder(buttonLadders[ladder], voltage, now) << (2 * ladder);
+  }
 
   return buttonStates;
 #else
@@ -619,40 +1236,74 @@ uint8_t Slave_::ledCountForChain(Board board) {
   }
 }
 
-uint8_t Slave_::ledPinForBoard(Board board) {
-  switch (board) {
-    case BOARD_L1:
-    case BOARD_L2:
-      return LEDL;
-      // TODO: PCB v!=3
-    case BOARD_M1:
-    case BOARD_M2:
-      return LEDM;
-    case BOARD_R1:
-    case BOARD_R2:
-      return LEDR;
-    default:
-      return 0;
-  }
+inline LedChain Slave_::ledChainForBoard(Board board) {
+  // TODO: PCB v!=3
+  return (LedChain) (board / 2);
 }
 
-void Slave_::initializeLedsForBoard(Board board) {
-  uint8_t ledPin = ledPinForBoard(board);
-  delete leds;
-  leds = new Adafruit_NeoPixel(ledCountForChain(board), ledPin, NEO_GRB + NEO_KHZ800);
-  leds->begin();
+// LEDs of a chain that the board config turns off stay dark
+void Slave_::setLedColor(Board board, uint16_t position, uint32_t color) {
+  const LedChain chain = ledChainForBoard(board);
+  if (!(enabledLedChains & (1 << chain))) {
+    color = 0;
+  }
+  if (ledChains[chain].getPixelColor(position) != color) {
+    ledChains[chain].setPixelColor(position, color);
+    dirtyLedChains |= 1 << chain;
+    ledsChanged = true;
+  }
 }
 
-void Slave_::setLedColor(uint16_t position, uint32_t color) {
-  leds->setPixelColor(position, color);
+void Slave_::fillLeds(Board board, uint32_t color, uint16_t first, uint16_t count) {
+  const uint16_t ledCount = ledCountForChain(board);
+  const uint16_t end = count == 0 ? ledCount : min(first + count, ledCount);
+  for (uint16_t i = first; i < end; ++i) {
+    setLedColor(board, i, color);
+  }
 }
 
-void Slave_::fillLeds(uint32_t color, uint16_t first, uint16_t count) {
-  leds->fill(color, first, count);
+void Slave_::showLeds() {
+  for (uint8_t i = 0; i < LED_CHAIN_COUNT; ++i) {
+    if (dirtyLedChains & (1 << i)) {
+      ledChains[i].show();
+    }
+  }
+  dirtyLedChains = 0;
 }
 
-void Slave_::showLeds() {
-  leds->show();
+// Called once per update() pass. All the changes made since the last show are
+// clocked out together once the rate limit and the encoders allow it.
+void Slave_::refreshLeds() {
+  if (ledsChanged) {
+    ledsChanged = false;
+    if (pendingLedFrames < UINT8_MAX) {
+      pendingLedFrames++;
+    }
+  }
+  if (!dirtyLedChains) {
+    return;
+  }
+
+  const uint16_t now = millis();
+  const uint16_t sinceShow = now - lastLedShowMillis;
+  if (sinceShow < LED_MIN_REFRESH_INTERVAL) {
+    return;
+  }
+  const bool encodersMoving = (uint16_t) (now - lastEncoderActivityMillis) < LED_ENCODER_QUIET_INTERVAL;
+  if (encodersMoving && sinceShow < LED_MAX_DEFER_INTERVAL) {
+    if (!ledFrameDeferred) {
+      ledFrameDeferred = true;
+      ledRefreshStats.deferredFrames++;
+    }
+    return;
+  }
+
+  showLeds();
+  lastLedShowMillis = now;
+  ledRefreshStats.shownFrames++;
+  ledRefreshStats.mergedFrames += pendingLedFrames - 1;
+  pendingLedFrames = 0;
+  ledFrameDeferred = false;
 }
 
 #endif
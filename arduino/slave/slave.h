@@ -9,19 +9,56 @@ typedef uint8_t byte;
 // TODO: if this is not imported here, the initialization will fail and the device will not work properly
 // TODO: this should be fixed in order to be able to use this code as a library
 #include "config.h"
+#include "log.h"
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
 #include <Adafruit_NeoPixel.h>
 #endif
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+#if PCB_VERSION == 3
+#include "quadrature.h"
+#else
 #include <RotaryEncoder.h>  
 #endif
+#endif
+
+#define HAS_INPUT_EVENTS (ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) || ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS) || ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH) || ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX))
+
+#include "message_outbox.h"
+#include "profiler.h"
+
+// Button edges, encoder deltas and debug messages waiting for the bus, positions have their own slots
+static const uint8_t MESSAGE_OUTBOX_FIFO_SIZE = 16;
+// A frame the master does not acknowledge is sent again, its messages count as dropped after this many tries
+static const uint8_t MESSAGE_FRAME_SEND_ATTEMPTS = 4;
+// The debug counters (DEBUG_INPUT_EVENTS_DROPPED and the like) go out at most this often
+static const uint16_t DEBUG_REPORT_INTERVAL_MILLIS = 1000;
+
+#ifdef PROFILER_ENABLED
+static const uint8_t PROFILE_REQUEST_PENDING = 0x80; // Next to the PROFILE_REQUEST_* flags
+#endif
+
+#if HAS_INPUT_EVENTS
+#include "ring_buffer.h"
 
-struct ButtonPairStates {
-  bool firstButtonState;
-  bool secondButtonState;
+static const uint8_t INPUT_EVENT_QUEUE_SIZE = 16;
+
+enum InputSource {
+  INPUT_SOURCE_SWITCH,
+  INPUT_SOURCE_PAD,
+  INPUT_SOURCE_TOUCH,
+  INPUT_SOURCE_MATRIX
 };
 
+// State snapshot pushed by the input ISRs whenever the states of a source change
+struct InputEvent {
+  uint8_t source : 4; // InputSource
+  uint8_t index : 4; // Board for pads, matrix * MATRIX_OUTPUTS + row for matrices
+  uint8_t states;
+  uint16_t time; // Low bits of micros() when the change was seen, the queue drains well within their wrap
+};
+#endif
+
 static const uint8_t ENCODER_PINS[BOARD_COUNT][2] = {
   {ENCL1A, ENCL1B},
   {ENCL2A, ENCL2B},
@@ -35,6 +72,137 @@ static const uint8_t ENCODER_PINS[BOARD_COUNT][2] = {
   {ENCR2A, ENCR2B}
 };
 
+#if PCB_VERSION == 3
+// Bit masks of the encoder pins within their port (PINB / PINC / PIND)
+#define ENCODER_PIN_MASK(PIN) (1 << digitalPinToPCMSKbit(PIN))
+static const uint8_t ENCODER_PIN_MASKS[BOARD_COUNT][2] = {
+  {ENCODER_PIN_MASK(ENCL1A), ENCODER_PIN_MASK(ENCL1B)},
+  {ENCODER_PIN_MASK(ENCL2A), ENCODER_PIN_MASK(ENCL2B)},
+  {ENCODER_PIN_MASK(ENCM1A), ENCODER_PIN_MASK(ENCM1B)},
+  {ENCODER_PIN_MASK(ENCM2A), ENCODER_PIN_MASK(ENCM2B)},
+  {ENCODER_PIN_MASK(ENCR1A), ENCODER_PIN_MASK(ENCR1B)},
+  {ENCODER_PIN_MASK(ENCR2A), ENCODER_PIN_MASK(ENCR2B)}
+};
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+// TODO: PCB v!=3
+enum LedChain {
+  LED_CHAIN_L,
+  LED_CHAIN_M,
+  LED_CHAIN_R,
+  LED_CHAIN_COUNT
+};
+
+struct LedRefreshStats {
+  uint16_t shownFrames;
+  uint16_t deferredFrames; // Frames held back because the encoders were moving
+  uint16_t mergedFrames; // Frames that were shown as part of a later frame
+};
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+// The two buttons of each side share a resistor ladder on one analog pin. The ADC
+// interrupt samples the ladders in turn, see Slave_::handleButtonSample().
+enum ButtonLadder {
+  BUTTON_LADDER_L,
+  BUTTON_LADDER_M,
+  BUTTON_LADDER_R,
+  BUTTON_LADDER_COUNT
+};
+
+static const uint8_t BUTTON_LADDER_CHANNELS[BUTTON_LADDER_COUNT] = {
+  analogPinToChannel(SWL),
+  analogPinToChannel(SWM),
+  analogPinToChannel(SWR)
+};
+
+static const bool BUTTON_LADDER_ENABLED[BUTTON_LADDER_COUNT] = {
+  HAS_FEATURE(L1, BOARD_FEATURE_BUTTON) || HAS_FEATURE(L2, BOARD_FEATURE_BUTTON),
+  HAS_FEATURE(M1, BOARD_FEATURE_BUTTON) || HAS_FEATURE(M2, BOARD_FEATURE_BUTTON),
+  HAS_FEATURE(R1, BOARD_FEATURE_BUTTON) || HAS_FEATURE(R2, BOARD_FEATURE_BUTTON)
+};
+
+// Button states of a ladder: bit 0 = first button, bit 1 = second button
+struct ButtonLadderState {
+  uint8_t stableStates; // Last reported states
+  uint8_t candidateStates; // States decoded from the latest sample
+  uint16_t candidateSinceMillis;
+};
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+// TODO: create a button matrix with LED support?
+static const uint8_t MATRIX_OUTPUTS = 3;
+static const uint8_t MATRIX_INPUTS = 3;
+static const uint8_t MAX_MATRIX_BOARD_COUNT = 2;
+static const uint8_t MATRIX_BOARDS[MAX_MATRIX_BOARD_COUNT] = {BOARD_L1, BOARD_R1};
+static const bool MATRIX_ENABLED[MAX_MATRIX_BOARD_COUNT] = {HAS_MATRIX(L1), HAS_MATRIX(R1)};
+
+static const uint8_t BUTTON_MATRIX_INPUT_PINS[MAX_MATRIX_BOARD_COUNT][MATRIX_INPUTS] = {
+  {
+    ENCL2B,
+    ENCL2A,
+    SWL
+  },
+  {
+    ENCR1B,
+    ENCR1A,
+#if PCB_VERSION == 3
+    LEDR // TODO: check that this is the correct pin
+#else
+    LED2
+#endif
+  }
+};
+
+static const uint8_t BUTTON_MATRIX_OUTPUT_PINS[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS] = {
+  {
+    ENCL1B,
+    ENCL1A,
+#if PCB_VERSION == 3
+    LEDL // TODO: check that this is the correct pin
+#else
+    LED1 // TODO: Which pin should this be? Jumper missing on board?
+#endif
+  },
+  {
+    ENCR2B,
+    ENCR2A,
+    SWR
+  }
+};
+
+// Every TIMER2_COMPA interrupt scans all rows of the enabled matrices: each row is driven low for
+// MATRIX_SETTLE_MICROS before its inputs are read, a full scan of both matrices takes under 100 µs.
+// A slow tick keeps the interrupt from delaying the encoder PCINTs too often.
+static const uint16_t MATRIX_SCAN_MICROS = 1000;
+static const uint8_t MATRIX_SETTLE_MICROS = 5;
+#endif
+
+// EEPROM: the slave address at 0, the unique id for the address enumeration at 8 (can be
+// programmed in production, otherwise made up on the first boot) and the board config at 16
+static const uint8_t UNIQUE_ID_EEPROM_ADDRESS = 8;
+static const uint8_t UNIQUE_ID_WATCHDOG_PERIODS = 16;
+static const uint8_t BOARD_CONFIG_EEPROM_ADDRESS = 16;
+static_assert(BOARD_COUNT <= BOARD_CONFIG_MAX_BOARDS, "Board config too small for the boards");
+
+enum EncoderMode : uint8_t {
+  ENCODER_MODE_DISABLED,
+  ENCODER_MODE_RELATIVE,
+  ENCODER_MODE_CLAMPED,
+  ENCODER_MODE_LOOPED
+};
+
+// Compiled from the board config by applyBoardConfig() so that update() does not decode it
+struct BoardSettings {
+  uint8_t features; // Built-in features that the config leaves on
+  EncoderMode encoderMode;
+  int8_t encoderDirection;
+  uint8_t minPosition;
+  uint8_t maxPosition;
+};
+
 class Slave_;
 typedef void (*ChangeHandler)(Board, ControlType, uint8_t /*input*/, uint8_t /*state*/);
 
@@ -45,21 +213,51 @@ public:
   void setup(ChangeHandler = NULL);
   void update();
   void sendMessageToMaster(byte input, uint16_t value, ControlType type);
+  void flushMessagesToMaster();
+#ifdef MESSAGE_POLLING_ENABLED
+  void handleMasterRequest();
+#endif
   void toggleBuiltinLed();
+#if PCB_VERSION == 3
+  // Called from the PCINT handlers with the port state read once per interrupt
+  inline void decodeEncoder(Board board, uint8_t portPins) {
+    encoders[board].tick(((portPins & ENCODER_PIN_MASKS[board][0]) ? 1 : 0) | ((portPins & ENCODER_PIN_MASKS[board][1]) ? 2 : 0));
+  }
+#else
   void tickEncoder(Board board);
+#endif
   int getPosition(Board board);
   uint8_t ledCountForChain(Board board);
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
   void updateSwitchStates();
+#if PCB_VERSION == 3
+  // Called from the ADC interrupt: stores the finished sample and starts the next ladder
+  inline void handleButtonSample() {
+    buttonSamples[sampledButtonLadder] = ADC;
+    do {
+      sampledButtonLadder = sampledButtonLadder + 1 == BUTTON_LADDER_COUNT ? 0 : sampledButtonLadder + 1;
+    } while (!BUTTON_LADDER_ENABLED[sampledButtonLadder]);
+    ADMUX = _BV(REFS0) | BUTTON_LADDER_CHANNELS[sampledButtonLadder];
+    ADCSRA |= _BV(ADSC);
+  }
+#endif
 #endif
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS)
   void updatePadStates();
 #endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH) && PCB_VERSION != 3 // TODO
+  void updateTouchStates();
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+  // Called from the TIMER2_COMPA interrupt: drives and samples every row of the enabled matrices
+  void scanMatrices();
+#endif
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
-  void initializeLedsForBoard(Board board);
-  void setLedColor(uint16_t position, uint32_t color);
-  void fillLeds(uint32_t color, uint16_t first = 0, uint16_t count = 0);
+  // Writes only mark the chain of the board dirty, showLeds() clocks out the dirty chains
+  void setLedColor(Board board, uint16_t position, uint32_t color);
+  void fillLeds(Board board, uint32_t color, uint16_t first = 0, uint16_t count = 0);
   void showLeds();
+  const LedRefreshStats& getLedRefreshStats() const { return ledRefreshStats; }
 
   static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
     return Adafruit_NeoPixel::Color(r, g, b);
@@ -69,37 +267,166 @@ public:
   }
 #endif
 
+  // Called from the Wire receive interrupt, the config is applied in update()
+  void handleMasterWrite(int length);
+  // localMicros (the slave's micros()) in the master's clock >> MESSAGE_TIME_SHIFT, the
+  // slave's own before the first time sync
+  uint16_t masterTime(uint32_t localMicros);
+
+#ifdef PROFILER_ENABLED
+  Profiler profiler; // Also recorded from the ISRs
+#endif
+
 private:
   inline void setupI2c();
+  inline void configureWire();
+  inline void loadBoardConfig();
+  uint8_t writeDefaultBoardConfig(uint8_t* config);
+  void applyBoardConfig(const uint8_t* config);
+  void storeReceivedBoardConfig();
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+  void syncEncoderPositions();
+#endif
   inline void setupPinModes();
   inline void setupInterrupts();
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+  inline void setupButtonSampling();
+#endif
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+  inline void setupMatrixScanner();
+#endif
   inline uint8_t readPadPin(uint8_t board, uint8_t pin);
   void handleButtonChange(uint8_t input, uint8_t state); // TODO make this customizable
   void handlePositionChange(uint8_t input, uint8_t state); // TODO make this customizable
   uint8_t requestAddress();
+  inline void loadUniqueId(uint8_t* uniqueId);
+  uint32_t generateUniqueId();
   void sendMessageToMaster(SlaveToMasterMessage& message);
+  void reportDebugCounters();
+#ifdef PROFILER_ENABLED
+  void reportProfile();
+#endif
+
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
+  inline LedChain ledChainForBoard(Board board);
+  void refreshLeds();
+#endif
 
-  uint8_t ledCountForBoard(Board board);
-  uint8_t ledPinForBoard(Board board);
-  uint8_t firstLedIndex(Board board);
+  #if HAS_INPUT_EVENTS
+  void pushInputEvent(InputSource source, uint8_t index, uint8_t states);
+  inline void handleInputEvent(const InputEvent& event);
+  #endif
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
+  void handleSwitchStates(uint8_t states);
+  #endif
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH) && PCB_VERSION != 3 // TODO
+  void handleTouchStates(uint8_t states);
+  #endif
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS) && PCB_VERSION != 3 // TODO
+  void handlePadStates(uint8_t board, uint8_t states);
+  #endif
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
+  void handleMatrixStates(uint8_t index, uint8_t states);
+  #endif
+
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+  // Specialized per board from BOARD_DESCRIPTORS, boards without an encoder compile to nothing
+  template<uint8_t BOARD> inline void updateEncoder();
+  template<uint8_t BOARD> inline void updateEncoders(); // BOARD and the boards after it
+  #endif
+
+  #ifdef ENCODER_ACCELERATION_ENABLED
+  // Detents sent per detent turned, from the time per detent since the previous change
+  uint8_t encoderAccelerationFactor(uint8_t board, int delta);
+  #endif
 
   #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
-  ButtonPairStates voltageToButtonStates(int voltage);
+  uint8_t voltageToButtonStates(int voltage, uint8_t stableStates);
   uint8_t getButtonStates();
   #endif
+  #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON) && PCB_VERSION == 3
+  uint8_t debounceButtonLadder(ButtonLadderState& ladder, int voltage, uint16_t now);
+  #endif
 
   ChangeHandler handler;
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
-  uint8_t currentLedPin = 0;
-  Adafruit_NeoPixel *leds = 0;
+  // One framebuffer per chain for the lifetime of the slave
+  Adafruit_NeoPixel ledChains[LED_CHAIN_COUNT] = {
+    {LED_COUNT_L, LEDL, NEO_GRB + NEO_KHZ800},
+    {LED_COUNT_M, LEDM, NEO_GRB + NEO_KHZ800},
+    {LED_COUNT_R, LEDR, NEO_GRB + NEO_KHZ800}
+  };
+  uint8_t dirtyLedChains = 0; // Bit per LedChain
+  uint8_t enabledLedChains = 0; // Chains with a board that the board config leaves BOARD_FEATURE_LED on
+
+  // Refresh scheduling, see refreshLeds()
+  bool ledsChanged = false; // LEDs written during the current update() pass
+  bool ledFrameDeferred = false;
+  uint8_t pendingLedFrames = 0; // update() passes that changed LEDs since the last show
+  uint16_t lastLedShowMillis = 0;
+  uint16_t lastEncoderActivityMillis = 0;
+  LedRefreshStats ledRefreshStats = {0, 0, 0};
+  LedRefreshStats reportedLedRefreshStats = {0, 0, 0};
 #endif
 
   volatile uint8_t address;
 
+  // Messages for the master, sent as v2 frames at the end of every update() pass
+  MessageOutbox<BOARD_COUNT, MESSAGE_OUTBOX_FIFO_SIZE> outbox;
+  uint16_t droppedMessages = 0;
+#ifndef MESSAGE_POLLING_ENABLED
+  // The frame on the bus stays in the outbox until transmitStatus() reports that the master took it
+  bool frameInFlight = false;
+  uint8_t frameSendFailures = 0;
+#endif
+  uint16_t reportedDroppedMessages = 0;
+  uint16_t reportedI2cErrors = 0;
+  uint16_t lastDebugReportMillis = 0;
+  // Master micros() - own micros(), set by the time syncs in the Wire receive interrupt
+  volatile uint32_t masterClockOffset = 0;
+  volatile bool masterClockSynced = false;
+  // Set while the handler runs for an encoder detent or an input event: the messages get the time
+  // of its pin edge or of the scan that saw the change
+  bool handlingEdge = false;
+  uint32_t handledEdgeMicros = 0;
+
+#ifdef MESSAGE_POLLING_ENABLED
+  // Frame waiting for the master to poll it. Filled in update() only when
+  // readyMessagesLength is 0, released by the master's POLL_ACK_COMMAND in handleMasterWrite().
+  uint8_t readyMessages[MESSAGE_FRAME_MAX_SIZE];
+  volatile uint8_t readyMessagesLength = 0;
+  volatile uint8_t readySequence = 0; // POLL_SEQUENCE_BIT, toggled for every frame
+  volatile bool frameRequested = false; // The last poll command was POLL_FRAME_COMMAND
+#endif
+
+  BoardSettings boardSettings[BOARD_COUNT];
+  uint8_t receivedBoardConfig[BOARD_CONFIG_MAX_SIZE];
+  volatile uint8_t receivedBoardConfigLength = 0; // Set by handleMasterWrite(), cleared in update()
+  uint8_t storedBoardConfigBytes = 0; // Of the received config, see storeReceivedBoardConfig()
+
+#ifdef PROFILER_ENABLED
+  // PROFILE_REQUEST_PENDING | flags of the request, set by handleMasterWrite(), cleared in update()
+  volatile uint8_t profileRequest = 0;
+  uint8_t reportedProfileSections = 0; // Sections answered for the current request
+#endif
+
+#if HAS_INPUT_EVENTS
+  // Written from the PCINT handlers (v1 / v2) or update() (v3), drained in update()
+  RingBuffer<InputEvent, INPUT_EVENT_QUEUE_SIZE> inputEvents;
+  uint16_t reportedInputEventOverflows = 0;
+#endif
+
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
-  uint8_t switchStates;
-  uint8_t previousSwitchStates;
+  uint8_t switchStates; // Last state pushed to inputEvents
+  uint8_t previousSwitchStates; // Last state handled in update()
+#if PCB_VERSION == 3
+  volatile uint16_t buttonSamples[BUTTON_LADDER_COUNT] = {0}; // Latest ADC result of each ladder
+  uint8_t sampledButtonLadder = 0; // Ladder being converted, only used in the ADC interrupt after setup
+  ButtonLadderState buttonLadders[BUTTON_LADDER_COUNT] = {};
+  uint16_t buttonGlitches = 0; // Decoded states that changed again before they settled
+  uint16_t reportedButtonGlitches = 0;
+#endif
 #endif
 
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_TOUCH)
@@ -111,18 +438,14 @@ private:
 
 // TODO: config should somehow be project specific if this code is to be used as a library
   #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
-  uint8_t previousMatrixButtonStates[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS] = {
-    {
-      0,
-      0,
-      0
-    },
-    {
-      0,
-      0,
-      0
-    }
-  };
+  uint8_t previousMatrixButtonStates[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS] = {}; // Last states handled in update()
+  // Only used in the TIMER2_COMPA interrupt after setup
+  uint8_t matrixRowStates[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS] = {}; // Last states pushed to inputEvents
+  // Port of each pin as an index from PB and its bit mask, resolved once in setupMatrixScanner()
+  uint8_t matrixInputPorts[MAX_MATRIX_BOARD_COUNT][MATRIX_INPUTS];
+  uint8_t matrixInputMasks[MAX_MATRIX_BOARD_COUNT][MATRIX_INPUTS];
+  uint8_t matrixOutputPorts[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS];
+  uint8_t matrixOutputMasks[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS];
   #endif
 
   #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_PADS)
@@ -131,6 +454,17 @@ private:
   #endif
 
   #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+  #if PCB_VERSION == 3
+  QuadratureEncoder encoders[BOARD_COUNT];
+
+  inline QuadratureEncoder& encoder(uint8_t board) {
+    return encoders[board];
+  }
+  #else
+  inline RotaryEncoder& encoder(uint8_t board) {
+    return *encoders[board];
+  }
+
   RotaryEncoder* encoders[BOARD_COUNT] = {
   #if BOARD_FEATURES_L1 & BOARD_FEATURE_ENCODER
   new RotaryEncoder(ENCODER_PINS[BOARD_L1][0], ENCODER_PINS[BOARD_L1][1])
@@ -177,7 +511,13 @@ private:
     0
     #endif
   };
+  #endif
+
+  #ifdef ENCODER_ACCELERATION_ENABLED
+  uint16_t lastEncoderChangeMillis[BOARD_COUNT] = {0};
+  #endif
 
+  // Last sent position, or for relative encoders the encoder position that has been sent as deltas
   int positions[BOARD_COUNT]  = {
     0,
     0,
@@ -206,11 +546,18 @@ private:
 
 #define BOARD_MATRIX_INDEX(BOARD) (BOARD == BOARD_L1 ? 0 : BOARD == BOARD_R1 ? 1 : -1)
 
+#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_ENCODER)
+// Largest relative change that fits in a single byte of the message encoding
+static const int8_t MAX_ENCODER_DELTA = 127;
+#endif
+
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_BUTTON)
 const int FIRST_BUTTON_VOLTAGE = 485;
 const int SECOND_BUTTON_VOLTAGE = 855;
 const int BOTH_BUTTONS_VOLTAGE = 583;
 const int BUTTON_VOLTAGE_RANGE = min(BOTH_BUTTONS_VOLTAGE - FIRST_BUTTON_VOLTAGE, SECOND_BUTTON_VOLTAGE - BOTH_BUTTONS_VOLTAGE) / 2;
+// Voltage of each state, indexed with the state bits (first button | second button << 1)
+const int BUTTON_STATE_VOLTAGES[] = {-1, FIRST_BUTTON_VOLTAGE, SECOND_BUTTON_VOLTAGE, BOTH_BUTTONS_VOLTAGE};
 
 #if PCB_VERSION == 3
 static const uint8_t BUTTON_PINS[] = {
@@ -264,47 +611,6 @@ static const uint8_t PAD_PINS[][4] {
 #endif
 #endif
 
-#if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_MATRIX)
-// TODO: create a button matrix with LED support?
-static const uint8_t MATRIX_OUTPUTS = 3;
-static const uint8_t MATRIX_INPUTS = 3;
-static const uint8_t MAX_MATRIX_BOARD_COUNT = 2;
-
-static const uint8_t BUTTON_MATRIX_INPUT_PINS[MAX_MATRIX_BOARD_COUNT][MATRIX_INPUTS] = {
-  {
-    ENCL2B,
-    ENCL2A,
-    SWL
-  },
-  {
-    ENCR1B,
-    ENCR1A,
-#if PCB_VERSION == 3
-    LEDR // TODO: check that this is the correct pin
-#else
-    LED2
-#endif
-  }
-};
-
-static const uint8_t BUTTON_MATRIX_OUTPUT_PINS[MAX_MATRIX_BOARD_COUNT][MATRIX_OUTPUTS] = {
-  {
-    ENCL1B,
-    ENCL1A,
-#if PCB_VERSION == 3
-    LEDL // TODO: check that this is the correct pin
-#else
-    LED1 // TODO: Which pin should this be? Jumper missing on board?
-#endif
-  },
-  {
-    ENCR2B,
-    ENCR2A,
-    SWR
-  }
-};
-#endif
-
 #if PCB_VERSION == 3
 #define BOARD_HAS_DEBUG_LED
 #endif
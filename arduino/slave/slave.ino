@@ -22,21 +22,24 @@ inline uint32_t colorForPosition(uint8_t position) {
 }
 #endif
 
-inline void setPositionLedOn(uint8_t position, Board board) {
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
-  const uint8_t firstIndex = board % 2 == 0 ? 0 : LED_COUNTS[board - 1];
-  Slave.setLedColor(position + firstIndex, colorForPosition(position));
-#endif
+inline uint32_t ledColorForBoard(Board board, uint8_t index) {
+  const int position = Slave.getPosition(board);
+  return index == position ? colorForPosition(position) : Slave.Color(0, 0, 0);
 }
+#endif
 
-void setLedPosition(Board board, byte position) {
+// Only the LEDs that change are written, the chain is clocked out at the end of Slave.update()
+void setLedPosition(Board board, byte position __attribute__((unused))) {
 #if ANY_BOARD_HAS_FEATURE(BOARD_FEATURE_LED)
-  Slave.initializeLedsForBoard(board);
-  Slave.fillLeds(Slave.Color(0, 0, 0), 0, Slave.ledCountForChain(board));
   const Board firstBoard = firstBoardInLedChain(board);
-  setPositionLedOn(Slave.getPosition(firstBoard), firstBoard);
-  setPositionLedOn(Slave.getPosition(firstBoard+1), firstBoard+1);
-  Slave.showLeds();
+  const uint8_t firstBoardLedCount = BOARD_DESCRIPTORS[firstBoard].ledCount;
+  for (uint8_t i = 0; i < Slave.ledCountForChain(board); ++i) {
+    const uint32_t color = i < firstBoardLedCount ?
+      ledColorForBoard(firstBoard, i) :
+      ledColorForBoard((Board) (firstBoard + 1), i - firstBoardLedCount);
+    Slave.setLedColor(board, i, color);
+  }
 #endif
 }
 
@@ -49,27 +52,16 @@ void handleChange(Board board, ControlType type, uint8_t input, uint8_t state) {
   switch (type) {
     // TODO: prevent input collisions on different boards
     case CONTROL_TYPE_POSITION: {
-      #ifdef USART_DEBUG_ENABLED
-        Serial.print("Pos change, board: ");
-        Serial.print(board);
-        Serial.print(", input: ");
-        Serial.print(input);
-        Serial.print(", pos: ");
-        Serial.println(state);
-      #endif
+      LOG(SLAVE_POSITION_CHANGE, board, input, state);
       sendChangeMessage(board, state, type);
       setLedPosition(board, state);
 
       break;
     }
     case CONTROL_TYPE_ENCODER: {
-      #ifdef USART_DEBUG_ENABLED
-        Serial.print("handleEncoderChange, input: ");
-        Serial.print(input);
-        Serial.print(", state: ");
-        Serial.println(state);
-      #endif
-      sendChangeMessage(board, state, type);
+      LOG(SLAVE_ENCODER_CHANGE, board, input, (int8_t) state);
+      // Relative changes are signed
+      sendChangeMessage(board, (int8_t) state, type);
       break;
     }
     case CONTROL_TYPE_BUTTON: {
@@ -77,6 +69,7 @@ void handleChange(Board board, ControlType type, uint8_t input, uint8_t state) {
 //      handleButtonChange(i, (switchStates & switchMask) ? 0 : 1);
 //      handleButtonChange(i, pinState);
       sendChangeMessage(board * 20 + input, state, type);
+      break;
     }
     default:
       sendChangeMessage(board, state, type);
@@ -100,7 +93,7 @@ void setup() {
   #endif
 
   for (byte i = 0; i <= BOARD_R2; ++i) {
-    setLedPosition(i, 0);
+    setLedPosition((Board) i, 0);
   }
 }
 
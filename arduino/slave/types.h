@@ -22,3 +22,18 @@ enum EncoderDirection {
   ENCODE_DIRECTION_CW = 1,
   ENCODE_DIRECTION_CCW = -1
 };
+
+// Compile-time description of a board, see BOARD_DESCRIPTORS in config.h
+struct BoardDescriptor {
+  uint8_t features;
+  uint8_t ledCount;
+  EncoderType encoderType;
+  EncoderDirection encoderDirection;
+  uint8_t minPosition;
+  uint8_t maxPosition;
+  bool loopPosition; // Wrap around at the limits instead of stopping
+
+  constexpr bool has(uint8_t feature) const {
+    return features & feature;
+  }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+typedef uint16_t neoPixelType;
+
+// Keeps the pixels in memory and counts the frames that would have been clocked out
+class Adafruit_NeoPixel
+{
+public:
+  Adafruit_NeoPixel(uint16_t n, uint16_t p = 6, neoPixelType t = NEO_GRB + NEO_KHZ800) : numLEDs(n), pin(p) {
+    pixels = new uint32_t[n]();
+  }
+  ~Adafruit_NeoPixel() { delete[] pixels; }
+  Adafruit_NeoPixel(const Adafruit_NeoPixel&) = delete;
+  Adafruit_NeoPixel& operator=(const Adafruit_NeoPixel&) = delete;
+
+  void begin() { pinMode(pin, OUTPUT); }
+  void show() { shownFrames++; }
+  bool canShow() { return true; }
+  void setPixelColor(uint16_t n, uint32_t c) { if (n < numLEDs) pixels[n] = c; }
+  uint32_t getPixelColor(uint16_t n) const { return n < numLEDs ? pixels[n] : 0; }
+  void fill(uint32_t c = 0, uint16_t first = 0, uint16_t count = 0) {
+    const uint16_t end = count == 0 ? numLEDs : min(first + count, numLEDs);
+    for (uint16_t i = first; i < end; ++i) pixels[i] = c;
+  }
+  uint16_t numPixels() const { return numLEDs; }
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t) r << 16) | ((uint32_t) g << 8) | b;
+  }
+  static uint32_t ColorHSV(uint16_t hue, uint8_t sat = 255, uint8_t val = 255) {
+    // Good enough for telling the colors apart, not the library's exact curve
+    const uint8_t sector = hue / 10923;
+    const uint8_t rise = (uint32_t) (hue % 10923) * 255 / 10923;
+    const uint8_t fall = 255 - rise;
+    const uint8_t rgb[6][3] = {{255, rise, 0}, {fall, 255, 0}, {0, 255, rise}, {0, fall, 255}, {rise, 0, 255}, {255, 0, fall}};
+    const uint8_t* c = rgb[sector % 6];
+    auto scale = [sat, val](uint8_t x) { return (uint8_t) ((255 - sat + (uint16_t) x * sat / 255) * val / 255); };
+    return Color(scale(c[0]), scale(c[1]), scale(c[2]));
+  }
+
+  uint32_t shownFrames = 0;
+
+private:
+  uint16_t numLEDs;
+  uint16_t pin;
+  uint32_t* pixels;
+};
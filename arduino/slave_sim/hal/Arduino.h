@@ -0,0 +1,87 @@
+#pragma once
+
+// Host replacement for the Arduino core, implemented in hal.cpp
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <type_traits>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define HEX 16
+#define DEC 10
+#define BIN 2
+
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+#define NOT_AN_INTERRUPT -1
+#define NOT_ON_TIMER 0
+
+// Functions instead of the core macros so that the standard headers keep working
+template<typename A, typename B>
+constexpr typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template<typename A, typename B>
+constexpr typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template<typename T, typename L, typename H>
+constexpr typename std::common_type<T, L, H>::type constrain(T x, L low, H high) {
+  return x < low ? low : x > high ? high : x;
+}
+
+#define PB 2
+#define PC 3
+#define PD 4
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+class HardwareSerial
+{
+public:
+  void begin(unsigned long) { enabled = true; }
+  template<typename T> void print(const T& value) { if (enabled) std::cout << +value; }
+  void print(const char* value) { if (enabled) std::cout << value; }
+  template<typename T> void print(const T& value, int base) {
+    if (enabled) std::cout << (base == HEX ? std::hex : std::dec) << +value << std::dec;
+  }
+  template<typename T> void println(const T& value) { print(value); println(); }
+  template<typename T> void println(const T& value, int base) { print(value, base); println(); }
+  void println() { if (enabled) std::cout << std::endl; }
+  size_t write(const uint8_t* buffer, size_t size) { if (enabled) std::cout.write((const char*) buffer, size); return size; }
+
+private:
+  bool enabled = false;
+};
+
+extern HardwareSerial Serial;
+
+// Like the core, pull in the variant pin definitions
+#include <pins_arduino.h>
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define E2END 0x1FF
+
+// ATmega168 EEPROM, erased to 0xFF
+struct EEPROMClass
+{
+  EEPROMClass() { memset(data, 0xFF, sizeof(data)); }
+  uint8_t read(int address) { return data[address]; }
+  void write(int address, uint8_t value) { data[address] = value; writes++; }
+  void update(int address, uint8_t value) { if (data[address] != value) write(address, value); }
+  uint16_t length() { return E2END + 1; }
+
+  uint8_t data[E2END + 1];
+  uint32_t writes = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+// <avr/eeprom.h>, writes finish at once on the host
+#define eeprom_is_ready() true
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+
+class MillisTimer
+{
+public:
+  typedef void (*Callback)(MillisTimer&);
+
+  MillisTimer(unsigned long interval, Callback callback) : interval(interval), callback(callback) {}
+  void start() { running = true; last = millis(); }
+  void stop() { running = false; }
+  void run() {
+    if (running && millis() - last >= interval) {
+      last += interval;
+      callback(*this);
+    }
+  }
+
+private:
+  unsigned long interval;
+  Callback callback;
+  unsigned long last = 0;
+  bool running = false;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 32
+
+#define WIRE_HAS_END 1
+#define WIRE_HAS_ASYNC_TRANSMIT 1
+#define WIRE_TRANSMIT_PENDING 0xFF
+#define WIRE_HAS_TIMEOUT 1
+#define WIRE_HAS_ERROR_COUNTS 1
+#define WIRE_HAS_GENERAL_CALL 1
+
+struct WireErrorCounts {
+  uint16_t timeouts;
+  uint16_t busErrors;
+  uint16_t arbitrationLost;
+  uint16_t addressNacks;
+  uint16_t dataNacks;
+  uint16_t busRecoveries;
+};
+
+// Simulated TWI with the API of the elysion Wire library. Transmissions to the
+// master are handed to sim::onMasterReceive(), requests are answered by the simulator.
+class TwoWire
+{
+public:
+  void begin() { address = 0; clockHz = 100000; generalCall = false; }
+  void begin(uint8_t ownAddress) { address = ownAddress; clockHz = 100000; generalCall = false; }
+  void begin(int ownAddress) { begin((uint8_t) ownAddress); }
+  void end() {}
+  void setClock(uint32_t hz) { clockHz = hz; }
+  void setGeneralCall(bool enable) { generalCall = enable; }
+  void setWireTimeout(uint32_t timeout = 25000, bool reset_with_timeout = false) { timeoutMicros = timeout; resetWithTimeout = reset_with_timeout; }
+  bool getWireTimeoutFlag() { return timeoutFlag; }
+  void clearWireTimeoutFlag() { timeoutFlag = false; }
+  void getErrorCounts(WireErrorCounts& counts) { counts = errorCounts; }
+
+  void beginTransmission(uint8_t destination);
+  void beginTransmission(int destination) { beginTransmission((uint8_t) destination); }
+  uint8_t endTransmission(uint8_t sendStop = true);
+  uint8_t endTransmissionAsync(uint8_t sendStop = true);
+  uint8_t transmitStatus();
+
+  uint8_t requestFrom(uint8_t source, uint8_t quantity);
+  uint8_t requestFrom(int source, int quantity) { return requestFrom((uint8_t) source, (uint8_t) quantity); }
+
+  size_t write(uint8_t data);
+  size_t write(const uint8_t* data, size_t quantity);
+  size_t write(int data) { return write((uint8_t) data); }
+  int available();
+  int read();
+  int peek();
+  void flush() {}
+
+  void onReceive(void (*handler)(int)) { user_onReceive = handler; }
+  void onRequest(void (*handler)(void)) { user_onRequest = handler; }
+  void onTransmitComplete(void (*handler)(uint8_t)) { user_onTransmitComplete = handler; }
+
+  // Simulator side
+  uint8_t address = 0;
+  uint32_t clockHz = 100000;
+  bool generalCall = false;
+  uint32_t timeoutMicros = 0;
+  bool resetWithTimeout = false;
+  bool timeoutFlag = false;
+  WireErrorCounts errorCounts = {};
+  void (*user_onReceive)(int) = 0;
+  void (*user_onRequest)(void) = 0;
+  void (*user_onTransmitComplete)(uint8_t) = 0;
+  uint8_t txAddress = 0;
+  uint8_t txBuffer[BUFFER_LENGTH];
+  uint8_t txBufferLength = 0;
+  uint8_t rxBuffer[BUFFER_LENGTH];
+  uint8_t rxBufferIndex = 0;
+  uint8_t rxBufferLength = 0;
+  uint8_t transmitResult = 0;
+  uint32_t pendingUntilMicros = 0;
+  bool completionPending = false;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "avr/io.h"
+
+// Vectors are plain functions that the simulator calls when an enabled interrupt fires
+#define ISR(vector, ...) extern "C" void vector(void)
+
+#define PCINT0_vect sim_PCINT0_vect
+#define PCINT1_vect sim_PCINT1_vect
+#define PCINT2_vect sim_PCINT2_vect
+#define TIMER1_COMPA_vect sim_TIMER1_COMPA_vect
+#define TIMER2_COMPA_vect sim_TIMER2_COMPA_vect
+#define ADC_vect sim_ADC_vect
+
+extern "C" void sim_PCINT0_vect(void);
+extern "C" void sim_PCINT1_vect(void);
+extern "C" void sim_PCINT2_vect(void);
+extern "C" void sim_ADC_vect(void) __attribute__((weak));
+extern "C" void sim_TIMER2_COMPA_vect(void) __attribute__((weak));
+
+#define cli() (SREG &= ~0x80)
+#define sei() (SREG |= 0x80)
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+// Simulated ATmega168 registers. Writes to PINx from the firmware are ignored by the
+// simulator: output pins follow PORTx, input pins are driven with sim::setPin().
+extern volatile uint8_t PINB, PINC, PIND;
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, OCR2A;
+extern volatile uint8_t WDTCSR; // The watchdog never times out
+extern volatile uint8_t ADMUX, ADCSRA;
+extern volatile uint16_t ADC;
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+
+#define REFS0 6
+#define REFS1 7
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+
+#define WDIF 7
+#define WDIE 6
+
+#define PCINT0 0
+#define PCINT1 1
+#define PCINT2 2
+#define PCINT3 3
+#define PCINT4 4
+#define PCINT5 5
+#define PCINT6 6
+#define PCINT7 7
+#define PCINT8 0
+#define PCINT9 1
+#define PCINT10 2
+#define PCINT11 3
+#define PCINT12 4
+#define PCINT13 5
+#define PCINT14 6
+#define PCINT16 0
+#define PCINT17 1
+#define PCINT18 2
+#define PCINT19 3
+#define PCINT20 4
+#define PCINT21 5
+#define PCINT22 6
+#define PCINT23 7
@@ -0,0 +1,477 @@
+#include <chrono>
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <pins_arduino.h>
+
+#include "shared.h"
+#include "sim.h"
+
+volatile uint8_t PINB, PINC, PIND;
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, OCR2A;
+volatile uint8_t WDTCSR;
+volatile uint8_t ADMUX, ADCSRA;
+volatile uint16_t ADC;
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+static const uint8_t PORT_COUNT = 3;
+static const uint8_t PIN_COUNT = 33;
+static const uint8_t ADC_CLOCKS_PER_CONVERSION = 13;
+static const uint8_t MAX_CONNECTIONS = 16;
+static const uint16_t TIMER2_PRESCALERS[] = {0, 1, 8, 32, 64, 128, 256, 1024};
+
+struct Connection {
+  uint8_t pin;
+  uint8_t otherPin;
+};
+
+static uint32_t currentMicros;
+static uint16_t analogValues[PIN_COUNT];
+static uint8_t assignedAddress;
+static uint8_t requestedUniqueId[UNIQUE_ID_SIZE];
+static bool addressRequested;
+static uint32_t transmitMicros;
+static uint8_t masterNacks;
+static sim::MasterReceiveHandler masterReceiveHandler;
+static sim::InterruptStats interruptStats[PORT_COUNT];
+static sim::InterruptStats adcStats;
+static sim::InterruptStats timer2Stats;
+static uint32_t timer2MatchMicros;
+static uint8_t externalPins[3]; // Levels driven with setPin()
+static Connection connections[MAX_CONNECTIONS];
+static uint8_t connectionCount;
+static uint32_t conversionStartMicros;
+static bool converting;
+static bool servingRequest;
+static uint8_t requestBuffer[BUFFER_LENGTH];
+static uint8_t requestLength;
+
+static volatile uint8_t* const PORT_PINS[PORT_COUNT] = {&PINB, &PINC, &PIND};
+static volatile uint8_t* const PORT_MASKS[PORT_COUNT] = {&PCMSK0, &PCMSK1, &PCMSK2};
+static volatile uint8_t* const PORT_OUTPUTS[PORT_COUNT] = {&PORTB, &PORTC, &PORTD};
+static volatile uint8_t* const PORT_DIRECTIONS[PORT_COUNT] = {&DDRB, &DDRC, &DDRD};
+static void (*const PORT_VECTORS[PORT_COUNT])(void) = {sim_PCINT0_vect, sim_PCINT1_vect, sim_PCINT2_vect};
+
+// The PCMSK register of a pin tells its port: PCMSK0 = B, PCMSK1 = C, PCMSK2 = D
+static int8_t portOfPin(uint8_t pin) {
+  if (pin == 0 || pin >= PIN_COUNT || pin == 19 || pin == 22) { // 19 and 22 are ADC6 and ADC7
+    return -1;
+  }
+  volatile uint8_t* mask = digitalPinToPCMSK(pin);
+  for (uint8_t port = 0; port < PORT_COUNT; ++port) {
+    if (mask == PORT_MASKS[port]) {
+      return port;
+    }
+  }
+  return -1;
+}
+
+static void runInterrupt(void (*vector)(void), sim::InterruptStats& stats) {
+  const uint8_t oldSREG = SREG;
+  cli();
+  const auto start = std::chrono::steady_clock::now();
+  vector();
+  stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  stats.calls++;
+  SREG = oldSREG;
+}
+
+// Pin number of an ADC channel, the inverse of analogPinToChannel()
+static uint8_t pinOfChannel(uint8_t channel) {
+  return channel == 6 ? 19 : channel == 7 ? 22 : channel + 23;
+}
+
+static uint32_t conversionMicros() {
+  const uint8_t prescaler = 1 << max(ADCSRA & 0x07, 1);
+  return (uint32_t) ADC_CLOCKS_PER_CONVERSION * prescaler * 1000000 / F_CPU;
+}
+
+// Finishes the conversions started with ADSC up to the current time
+static void runConversions(uint32_t fromMicros) {
+  uint32_t now = fromMicros;
+  while ((ADCSRA & _BV(ADEN)) && (ADCSRA & _BV(ADSC))) {
+    if (!converting) {
+      converting = true;
+      conversionStartMicros = now;
+    }
+    const uint32_t endMicros = conversionStartMicros + conversionMicros();
+    if ((int32_t) (currentMicros - endMicros) < 0) {
+      return;
+    }
+    now = endMicros;
+    converting = false;
+    ADC = analogValues[pinOfChannel(ADMUX & 0x0F)];
+    ADCSRA &= ~_BV(ADSC);
+    ADCSRA |= _BV(ADIF);
+    if ((ADCSRA & _BV(ADIE)) && (SREG & 0x80) && sim_ADC_vect) {
+      ADCSRA &= ~_BV(ADIF);
+      runInterrupt(sim_ADC_vect, adcStats);
+    }
+  }
+}
+
+static void runPendingInterrupts() {
+  if (!(SREG & 0x80)) {
+    return;
+  }
+  for (uint8_t port = 0; port < PORT_COUNT; ++port) {
+    if (PCIFR & _BV(port)) {
+      PCIFR &= ~_BV(port);
+      runInterrupt(PORT_VECTORS[port], interruptStats[port]);
+    }
+  }
+}
+
+// Recomputes PINx from the outputs, the driven inputs and the closed switches and flags the
+// pin change interrupts of the pins that changed
+static void updatePins() {
+  uint8_t levels[PORT_COUNT];
+  for (uint8_t port = 0; port < PORT_COUNT; ++port) {
+    levels[port] = (*PORT_OUTPUTS[port] & *PORT_DIRECTIONS[port]) | (externalPins[port] & ~*PORT_DIRECTIONS[port]);
+  }
+  for (uint8_t i = 0; i < connectionCount; ++i) {
+    const int8_t port = portOfPin(connections[i].pin);
+    const int8_t otherPort = portOfPin(connections[i].otherPin);
+    const uint8_t bit = _BV(digitalPinToPCMSKbit(connections[i].pin));
+    const uint8_t otherBit = _BV(digitalPinToPCMSKbit(connections[i].otherPin));
+    if (!(levels[port] & bit) && !(*PORT_DIRECTIONS[otherPort] & otherBit)) {
+      levels[otherPort] &= ~otherBit;
+    }
+    if (!(levels[otherPort] & otherBit) && !(*PORT_DIRECTIONS[port] & bit)) {
+      levels[port] &= ~bit;
+    }
+  }
+  for (uint8_t port = 0; port < PORT_COUNT; ++port) {
+    const uint8_t changed = *PORT_PINS[port] ^ levels[port];
+    *PORT_PINS[port] = levels[port];
+    if ((PCICR & _BV(port)) && (*PORT_MASKS[port] & changed)) {
+      PCIFR |= _BV(port);
+    }
+  }
+  runPendingInterrupts();
+}
+
+static void writePinLevel(uint8_t pin, bool high) {
+  const int8_t port = portOfPin(pin);
+  if (port < 0) {
+    return;
+  }
+  const uint8_t bit = _BV(digitalPinToPCMSKbit(pin));
+  externalPins[port] = high ? externalPins[port] | bit : externalPins[port] & ~bit;
+  updatePins();
+}
+
+static uint32_t timer2PeriodMicros() {
+  const uint16_t prescaler = TIMER2_PRESCALERS[TCCR2B & 0x07];
+  return max((uint32_t) (OCR2A + 1) * prescaler * 1000000 / F_CPU, (uint32_t) 1);
+}
+
+// Runs the Timer2 compare match interrupts (CTC mode) that fall before endMicros
+static void runTimer2(uint32_t endMicros) {
+  if (!(TIMSK2 & _BV(OCIE2A)) || !(TCCR2B & 0x07)) {
+    timer2MatchMicros = currentMicros + timer2PeriodMicros();
+    return;
+  }
+  while ((int32_t) (endMicros - timer2MatchMicros) >= 0) {
+    const uint32_t fromMicros = currentMicros;
+    currentMicros = timer2MatchMicros;
+    runConversions(fromMicros);
+    if ((SREG & 0x80) && sim_TIMER2_COMPA_vect) {
+      runInterrupt(sim_TIMER2_COMPA_vect, timer2Stats);
+      updatePins();
+    }
+    timer2MatchMicros += timer2PeriodMicros();
+  }
+}
+
+namespace sim {
+
+void reset() {
+  currentMicros = 0;
+  PINB = PINC = PIND = 0xFF;
+  PORTB = PORTC = PORTD = 0;
+  DDRB = DDRC = DDRD = 0;
+  externalPins[0] = externalPins[1] = externalPins[2] = 0xFF;
+  connectionCount = 0;
+  TCCR2A = TCCR2B = TIMSK2 = OCR2A = 0;
+  timer2MatchMicros = 0;
+  memset(&timer2Stats, 0, sizeof(timer2Stats));
+  PCICR = PCIFR = PCMSK0 = PCMSK1 = PCMSK2 = 0;
+  SREG = 0x80;
+  memset(analogValues, 0, sizeof(analogValues));
+  memset(interruptStats, 0, sizeof(interruptStats));
+  memset(&adcStats, 0, sizeof(adcStats));
+  ADMUX = ADCSRA = 0;
+  ADC = 0;
+  converting = false;
+  assignedAddress = MASTER_ADDRESS + 1;
+  addressRequested = false;
+  transmitMicros = 0;
+  masterNacks = 0;
+  masterReceiveHandler = 0;
+}
+
+void advanceMicros(uint32_t micros) {
+  const uint32_t endMicros = currentMicros + micros;
+  updatePins();
+  runTimer2(endMicros);
+  const uint32_t fromMicros = currentMicros;
+  currentMicros = endMicros;
+  runConversions(fromMicros);
+  if (Wire.completionPending && Wire.transmitStatus() != WIRE_TRANSMIT_PENDING) {
+    Wire.completionPending = false;
+    if (Wire.user_onTransmitComplete) {
+      Wire.user_onTransmitComplete(Wire.transmitResult);
+    }
+  }
+}
+
+uint32_t nowMicros() {
+  return currentMicros;
+}
+
+void setPin(uint8_t pin, bool high) {
+  writePinLevel(pin, high);
+}
+
+bool getPin(uint8_t pin) {
+  const int8_t port = portOfPin(pin);
+  return port >= 0 && (*PORT_PINS[port] & _BV(digitalPinToPCMSKbit(pin)));
+}
+
+void connectPins(uint8_t pin, uint8_t otherPin, bool connected) {
+  for (uint8_t i = 0; i < connectionCount; ++i) {
+    if ((connections[i].pin == pin && connections[i].otherPin == otherPin) || (connections[i].pin == otherPin && connections[i].otherPin == pin)) {
+      if (!connected) {
+        connections[i] = connections[--connectionCount];
+        updatePins();
+      }
+      return;
+    }
+  }
+  if (connected && connectionCount < MAX_CONNECTIONS && portOfPin(pin) >= 0 && portOfPin(otherPin) >= 0) {
+    connections[connectionCount++] = {pin, otherPin};
+    updatePins();
+  }
+}
+
+void setAnalog(uint8_t pin, uint16_t value) {
+  analogValues[pin] = value;
+}
+
+void setAssignedAddress(uint8_t address) {
+  assignedAddress = address;
+}
+
+void setMasterReceiveHandler(MasterReceiveHandler handler) {
+  masterReceiveHandler = handler;
+}
+
+void setTransmitMicros(uint32_t micros) {
+  transmitMicros = micros;
+}
+
+void setMasterNacks(uint8_t frames) {
+  masterNacks = frames;
+}
+
+uint8_t requestFromSlave(uint8_t* buffer, uint8_t quantity) {
+  if (!Wire.user_onRequest) {
+    return 0;
+  }
+  servingRequest = true;
+  requestLength = 0;
+  Wire.user_onRequest();
+  servingRequest = false;
+  const uint8_t received = min(quantity, requestLength);
+  memcpy(buffer, requestBuffer, received);
+  return received;
+}
+
+void writeToSlave(const uint8_t* data, uint8_t length) {
+  if (!Wire.user_onReceive) {
+    return;
+  }
+  Wire.rxBufferIndex = 0;
+  Wire.rxBufferLength = min(length, (uint8_t) BUFFER_LENGTH);
+  memcpy(Wire.rxBuffer, data, Wire.rxBufferLength);
+  Wire.user_onReceive(Wire.rxBufferLength);
+}
+
+const InterruptStats& pinChangeInterruptStats(uint8_t port) {
+  return interruptStats[port];
+}
+
+const InterruptStats& adcInterruptStats() {
+  return adcStats;
+}
+
+const InterruptStats& timer2InterruptStats() {
+  return timer2Stats;
+}
+
+}
+
+uint8_t digitalPinToPort(uint8_t pin) {
+  const int8_t port = portOfPin(pin);
+  return port < 0 ? NOT_A_PORT : PB + port;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+  return portOfPin(pin) < 0 ? 0 : _BV(digitalPinToPCMSKbit(pin));
+}
+
+static void writeRegisterBit(volatile uint8_t* const registers[], uint8_t pin, bool set) {
+  const int8_t port = portOfPin(pin);
+  if (port < 0) {
+    return;
+  }
+  const uint8_t bit = _BV(digitalPinToPCMSKbit(pin));
+  *registers[port] = set ? *registers[port] | bit : *registers[port] & ~bit;
+  updatePins();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  writeRegisterBit(PORT_DIRECTIONS, pin, mode == OUTPUT);
+  if (mode != OUTPUT) {
+    writeRegisterBit(PORT_OUTPUTS, pin, mode == INPUT_PULLUP);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  writeRegisterBit(PORT_OUTPUTS, pin, value != LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  return sim::getPin(pin) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  return pin < PIN_COUNT ? analogValues[pin] : 0;
+}
+
+unsigned long millis() {
+  return currentMicros / 1000;
+}
+
+unsigned long micros() {
+  return currentMicros;
+}
+
+void delay(unsigned long ms) {
+  sim::advanceMicros(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advanceMicros(us);
+}
+
+static uint32_t randomState = 1;
+
+long random(long howBig) {
+  if (howBig == 0) {
+    return 0;
+  }
+  randomState = randomState * 1103515245 + 12345;
+  return (randomState >> 1) % howBig;
+}
+
+long random(long howSmall, long howBig) {
+  return howSmall >= howBig ? howSmall : random(howBig - howSmall) + howSmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) {
+    randomState = seed;
+  }
+}
+
+void TwoWire::beginTransmission(uint8_t destination) {
+  txAddress = destination;
+  txBufferLength = 0;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t sendStop) {
+  (void) sendStop;
+  const uint8_t length = txBufferLength;
+  txBufferLength = 0;
+  if (txAddress != MASTER_ADDRESS) {
+    return 2; // Address NACK
+  }
+  if (length == ADDRESS_REQUEST_SIZE && txBuffer[0] == ADDRESS_REQUEST_COMMAND) {
+    memcpy(requestedUniqueId, txBuffer + 1, UNIQUE_ID_SIZE);
+    addressRequested = true;
+    return 0;
+  }
+  if (masterNacks) {
+    masterNacks--;
+    return 3; // Data NACK
+  }
+  if (masterReceiveHandler) {
+    masterReceiveHandler(address, txBuffer, length);
+  }
+  return 0;
+}
+
+uint8_t TwoWire::endTransmissionAsync(uint8_t sendStop) {
+  if (transmitStatus() == WIRE_TRANSMIT_PENDING) {
+    txBufferLength = 0;
+    return 5;
+  }
+  transmitResult = endTransmission(sendStop);
+  pendingUntilMicros = currentMicros + transmitMicros;
+  completionPending = true;
+  return 0;
+}
+
+uint8_t TwoWire::transmitStatus() {
+  return (int32_t) (currentMicros - pendingUntilMicros) < 0 ? WIRE_TRANSMIT_PENDING : transmitResult;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t source, uint8_t quantity) {
+  rxBufferIndex = 0;
+  rxBufferLength = 0;
+  // The master answers the address request with the requested id and the address
+  if (source == MASTER_ADDRESS && addressRequested && quantity == ADDRESS_RESPONSE_SIZE) {
+    memcpy(rxBuffer, requestedUniqueId, UNIQUE_ID_SIZE);
+    rxBuffer[UNIQUE_ID_SIZE] = assignedAddress;
+    rxBufferLength = ADDRESS_RESPONSE_SIZE;
+    addressRequested = false;
+  }
+  return rxBufferLength;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity) {
+  uint8_t* buffer = servingRequest ? requestBuffer : txBuffer;
+  uint8_t& length = servingRequest ? requestLength : txBufferLength;
+  const size_t written = min(quantity, (size_t) (BUFFER_LENGTH - length));
+  memcpy(buffer + length, data, written);
+  length += written;
+  return written;
+}
+
+int TwoWire::available() {
+  return rxBufferLength - rxBufferIndex;
+}
+
+int TwoWire::read() {
+  return rxBufferIndex < rxBufferLength ? rxBuffer[rxBufferIndex++] : -1;
+}
+
+int TwoWire::peek() {
+  return rxBufferIndex < rxBufferLength ? rxBuffer[rxBufferIndex] : -1;
+}
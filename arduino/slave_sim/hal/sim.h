@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Driver side of the simulated hardware. Time only moves with advanceMicros()
+// (and the firmware's own delay() calls), so every run is deterministic.
+namespace sim {
+
+typedef void (*MasterReceiveHandler)(uint8_t slaveAddress, const uint8_t* data, uint8_t length);
+
+struct InterruptStats {
+  uint32_t calls;
+  uint64_t nanos; // Host time spent in the handler
+};
+
+void reset();
+
+void advanceMicros(uint32_t micros);
+uint32_t nowMicros();
+
+// Drives an input pin and runs the pin change interrupt of its port if it is enabled.
+// Undriven inputs read high (pull-ups).
+void setPin(uint8_t pin, bool high);
+bool getPin(uint8_t pin);
+// Closes or opens a switch between two pins, e.g. a matrix key: a pin driven low pulls the other one low
+void connectPins(uint8_t pin, uint8_t otherPin, bool connected);
+// 10-bit value returned by analogRead(pin)
+void setAnalog(uint8_t pin, uint16_t value);
+
+// Address handed out when the slave asks the master for one
+void setAssignedAddress(uint8_t address);
+void setMasterReceiveHandler(MasterReceiveHandler handler);
+// How long asynchronous transmissions stay pending
+void setTransmitMicros(uint32_t micros);
+// The master NACKs the next frames that the slave sends
+void setMasterNacks(uint8_t frames);
+// Master read from the slave (polling mode), returns the number of bytes received
+uint8_t requestFromSlave(uint8_t* buffer, uint8_t quantity);
+// Master write to the slave, runs the slave's receive handler
+void writeToSlave(const uint8_t* data, uint8_t length);
+
+const InterruptStats& pinChangeInterruptStats(uint8_t port); // 0 = PCINT0 (PINB) .. 2 = PCINT2 (PIND)
+const InterruptStats& adcInterruptStats();
+const InterruptStats& timer2InterruptStats();
+
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "avr/io.h"
+
+// The simulated ISRs run synchronously from the driver, so there is nothing to protect against
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (uint8_t atomicBlockDone = 0; !atomicBlockDone; atomicBlockDone = 1)
@@ -0,0 +1,4 @@
+#pragma once
+
+// The simulated pins settle at once, and the ISRs that busy-wait must not move the simulated time
+#define _delay_us(us) ((void) (us))
@@ -0,0 +1,446 @@
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+
+#include "sim.h"
+#include "slave.h"
+
+// Drives the slave firmware on the host: injects quadrature waveforms and button
+// voltages, records the SlaveToMasterMessages it sends and times update() and the
+// pin change interrupts. Returns the number of failed checks.
+
+void setup();
+void loop();
+
+static const uint32_t LOOP_MICROS = 100; // Simulated time per loop() pass
+static const uint8_t SLAVE_ADDRESS = 0x10;
+// The simulated master's micros() is ahead of the slave's by this
+static const uint32_t MASTER_CLOCK_OFFSET = 3000000000UL;
+
+// state = A | (B << 1), one detent in the increasing direction
+static const uint8_t QUADRATURE_CW[] = {1, 0, 2, 3};
+
+static bool verbose = false;
+static std::vector<SlaveToMasterMessage> messages;
+static uint32_t receivedFrames = 0;
+static uint32_t loopCalls = 0;
+static uint64_t loopNanos = 0;
+static uint8_t failures = 0;
+
+static void recordMessage(const SlaveToMasterMessage& message) {
+  messages.push_back(message);
+  if (verbose) {
+    printf("%8.3f ms  address %u, type %u, input %u, value %d, event at %.3f ms\n", sim::nowMicros() / 1000.0, message.address, message.type, message.input, (int16_t) message.value, (message.time - MASTER_CLOCK_OFFSET) / 1000.0);
+  }
+}
+
+static void onMasterReceive(uint8_t address __attribute__((unused)), const uint8_t* data, uint8_t length) {
+  receivedFrames++;
+  dispatchMessageFrame(data, length, recordMessage, sim::nowMicros() + MASTER_CLOCK_OFFSET);
+}
+
+#ifdef MESSAGE_POLLING_ENABLED
+// The master side of the polling handshake (see POLL_LENGTH_COMMAND and master/polling.h) with
+// faults that are injected once: an acknowledgement that the slave does not get, one that the
+// slave gets but the master sees fail, and a frame read that comes back short.
+enum PollFault {
+  POLL_FAULT_NONE,
+  POLL_FAULT_ACK_LOST,
+  POLL_FAULT_ACK_UNCONFIRMED,
+  POLL_FAULT_SHORT_FRAME
+};
+
+static PollFault pollFault = POLL_FAULT_NONE;
+static uint8_t pendingAck = 0;
+static uint32_t pollSyncErrors = 0;
+static uint32_t pollIntervalMicros = 0;
+static uint32_t lastPollMicros = 0;
+
+static bool acknowledgeFrame(uint8_t lengthByte) {
+  const uint8_t ack[POLL_ACK_SIZE] = {POLL_ACK_COMMAND, lengthByte};
+  if (pollFault == POLL_FAULT_ACK_LOST) {
+    pollFault = POLL_FAULT_NONE;
+    return false;
+  }
+  sim::writeToSlave(ack, sizeof(ack));
+  if (pollFault == POLL_FAULT_ACK_UNCONFIRMED) {
+    pollFault = POLL_FAULT_NONE;
+    return false;
+  }
+  return true;
+}
+
+static void pollSlave() {
+  if ((uint32_t) (sim::nowMicros() - lastPollMicros) < pollIntervalMicros) {
+    return;
+  }
+  lastPollMicros = sim::nowMicros();
+  if (pendingAck != 0) {
+    if (!acknowledgeFrame(pendingAck)) {
+      return;
+    }
+    pendingAck = 0;
+  }
+
+  const uint8_t lengthCommand = POLL_LENGTH_COMMAND;
+  uint8_t lengthByte = 0;
+  sim::writeToSlave(&lengthCommand, 1);
+  if (sim::requestFromSlave(&lengthByte, POLL_LENGTH_SIZE) != POLL_LENGTH_SIZE || lengthByte == 0) {
+    return;
+  }
+  const uint8_t length = lengthByte & POLL_LENGTH_MASK;
+  if (lengthByte & MESSAGE_FRAME_VERSION_MASK || length == 0 || length > MESSAGE_FRAME_MAX_SIZE) {
+    pollSyncErrors++;
+    return;
+  }
+
+  const uint8_t frameCommand = POLL_FRAME_COMMAND;
+  uint8_t frame[MESSAGE_FRAME_MAX_SIZE];
+  sim::writeToSlave(&frameCommand, 1);
+  uint8_t received = sim::requestFromSlave(frame, length);
+  if (pollFault == POLL_FAULT_SHORT_FRAME) {
+    pollFault = POLL_FAULT_NONE;
+    received--;
+  }
+  if (received != length) {
+    pollSyncErrors++;
+    return;
+  }
+  if (!acknowledgeFrame(lengthByte)) {
+    pendingAck = lengthByte;
+  }
+  onMasterReceive(SLAVE_ADDRESS, frame, length);
+}
+#endif
+
+// A busy bus: pushed frames take this long, polls come at most this often
+static void setBusMicros(uint32_t micros) {
+  sim::setTransmitMicros(micros);
+#ifdef MESSAGE_POLLING_ENABLED
+  pollIntervalMicros = micros;
+#endif
+}
+
+static void runLoop(uint32_t micros) {
+  for (uint32_t elapsed = 0; elapsed < micros; elapsed += LOOP_MICROS) {
+    const auto start = std::chrono::steady_clock::now();
+    loop();
+    loopNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    loopCalls++;
+#ifdef MESSAGE_POLLING_ENABLED
+    pollSlave();
+#endif
+    sim::advanceMicros(LOOP_MICROS);
+  }
+}
+
+static void writeEncoderState(Board board, uint8_t state) {
+  sim::setPin(ENCODER_PINS[board][0], state & 1);
+  sim::setPin(ENCODER_PINS[board][1], state & 2);
+}
+
+// Turns the encoder of board by detents (negative = decreasing) with microsPerEdge between the edges
+static void turnEncoder(Board board, int detents, uint32_t microsPerEdge) {
+  for (int i = 0; i < abs(detents); ++i) {
+    for (uint8_t edge = 0; edge < sizeof(QUADRATURE_CW); ++edge) {
+      const uint8_t index = detents > 0 ? edge : (sizeof(QUADRATURE_CW) - 2 - edge) & 3;
+      writeEncoderState(board, QUADRATURE_CW[index]);
+      runLoop(microsPerEdge);
+    }
+  }
+}
+
+static const SlaveToMasterMessage* lastMessage(ControlType type, uint8_t input) {
+  for (auto message = messages.rbegin(); message != messages.rend(); ++message) {
+    if (message->type == type && message->input == input) {
+      return &*message;
+    }
+  }
+  return 0;
+}
+
+static uint32_t countMessages(ControlType type, uint8_t input, size_t from) {
+  uint32_t count = 0;
+  for (size_t i = from; i < messages.size(); ++i) {
+    count += messages[i].type == type && messages[i].input == input;
+  }
+  return count;
+}
+
+// Sum of the signed values, for the relative encoder deltas
+static int32_t sumMessages(ControlType type, uint8_t input, size_t from) {
+  int32_t sum = 0;
+  for (size_t i = from; i < messages.size(); ++i) {
+    sum += messages[i].type == type && messages[i].input == input ? (int16_t) messages[i].value : 0;
+  }
+  return sum;
+}
+
+// Largest magnitude of the signed values, 0 without messages
+static int16_t maxMessageMagnitude(ControlType type, uint8_t input, size_t from) {
+  int16_t magnitude = 0;
+  for (size_t i = from; i < messages.size(); ++i) {
+    if (messages[i].type == type && messages[i].input == input) {
+      magnitude = max(magnitude, (int16_t) abs((int16_t) messages[i].value));
+    }
+  }
+  return magnitude;
+}
+
+static void check(const char* name, bool passed) {
+  printf("%s: %s\n", passed ? "PASS" : "FAIL", name);
+  failures += passed ? 0 : 1;
+}
+
+static void checkLastValue(const char* name, ControlType type, uint8_t input, int16_t expected) {
+  const SlaveToMasterMessage* message = lastMessage(type, input);
+  const bool passed = message && (int16_t) message->value == expected;
+  check(name, passed);
+  if (!passed) {
+    printf("  expected %d, got %d\n", expected, message ? (int16_t) message->value : -1);
+  }
+}
+
+static void printInterruptStats() {
+  for (uint8_t port = 0; port < 3; ++port) {
+    const sim::InterruptStats& stats = sim::pinChangeInterruptStats(port);
+    printf("PCINT%u: %u calls, %.0f ns per call\n", port, stats.calls, stats.calls ? (double) stats.nanos / stats.calls : 0.0);
+  }
+  const sim::InterruptStats& adcStats = sim::adcInterruptStats();
+  printf("ADC: %u calls, %.0f ns per call\n", adcStats.calls, adcStats.calls ? (double) adcStats.nanos / adcStats.calls : 0.0);
+  printf("loop(): %u calls, %.0f ns per call\n", loopCalls, loopCalls ? (double) loopNanos / loopCalls : 0.0);
+}
+
+int main(int argc, char** argv) {
+  verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+
+  sim::reset();
+  sim::setAssignedAddress(SLAVE_ADDRESS);
+  sim::setMasterReceiveHandler(onMasterReceive);
+
+  setup();
+  runLoop(10000);
+  checkLastValue("boot requests an address", CONTROL_TYPE_DEBUG, DEBUG_RECEIVED_ADDRESS, SLAVE_ADDRESS);
+  check("address stored in EEPROM", EEPROM.read(0) == SLAVE_ADDRESS);
+  check("unique id stored in EEPROM", EEPROM.read(UNIQUE_ID_EEPROM_ADDRESS) != 0xFF);
+  check("I2C in fast mode with a bus timeout", Wire.clockHz == I2C_CLOCK_HZ && Wire.timeoutMicros == I2C_TIMEOUT_MICROS && Wire.resetWithTimeout);
+
+  Wire.errorCounts.timeouts = 2;
+  Wire.errorCounts.busErrors = 1;
+  runLoop(DEBUG_REPORT_INTERVAL_MILLIS * 1000UL);
+  checkLastValue("I2C timeouts and bus errors reported", CONTROL_TYPE_DEBUG, DEBUG_I2C_ERRORS, 3);
+
+#if PCB_VERSION == 3
+  turnEncoder(BOARD_L1, 2, 500);
+  runLoop(10000);
+  checkLastValue("L1 turned 2 detents", CONTROL_TYPE_POSITION, BOARD_L1, 2);
+
+  turnEncoder(BOARD_L1, 5, 500);
+  runLoop(10000);
+  checkLastValue("L1 stops at the upper limit", CONTROL_TYPE_POSITION, BOARD_L1, BOARD_DESCRIPTORS[BOARD_L1].maxPosition);
+
+  turnEncoder(BOARD_R1, -1, 500);
+  runLoop(10000);
+  checkLastValue("R1 loops below the lower limit", CONTROL_TYPE_POSITION, BOARD_R1, BOARD_DESCRIPTORS[BOARD_R1].maxPosition);
+
+  sim::setAnalog(SWR, FIRST_BUTTON_VOLTAGE);
+  runLoop(20000);
+  checkLastValue("R1 button pressed", CONTROL_TYPE_BUTTON, BOARD_R1 * 20, 1);
+  sim::setAnalog(SWR, 0);
+  runLoop(20000);
+  checkLastValue("R1 button released", CONTROL_TYPE_BUTTON, BOARD_R1 * 20, 0);
+
+  // The ladder passes the first and both buttons windows on the way to the second button
+  const size_t transitionFrom = messages.size();
+  sim::setAnalog(SWR, FIRST_BUTTON_VOLTAGE);
+  runLoop(1000);
+  sim::setAnalog(SWR, BOTH_BUTTONS_VOLTAGE);
+  runLoop(1000);
+  sim::setAnalog(SWR, SECOND_BUTTON_VOLTAGE);
+  runLoop(20000);
+  checkLastValue("R2 button pressed", CONTROL_TYPE_BUTTON, BOARD_R2 * 20, 1);
+  check("R1 button not pressed during the transition", countMessages(CONTROL_TYPE_BUTTON, BOARD_R1 * 20, transitionFrom) == 0);
+  runLoop(DEBUG_REPORT_INTERVAL_MILLIS * 1000UL);
+  checkLastValue("transition glitches counted", CONTROL_TYPE_DEBUG, DEBUG_BUTTON_GLITCHES, 2);
+  sim::setAnalog(SWR, 0);
+  runLoop(20000);
+  checkLastValue("R2 button released", CONTROL_TYPE_BUTTON, BOARD_R2 * 20, 0);
+
+  // Board config from the master: L1 loops over 0..5, R2 button off
+  uint8_t config[BOARD_CONFIG_MAX_SIZE + 1] = {BOARD_CONFIG_COMMAND};
+  const uint8_t configLength = boardConfigSize(BOARD_COUNT);
+  for (uint8_t i = 0; i < configLength; ++i) {
+    config[i + 1] = EEPROM.read(BOARD_CONFIG_EEPROM_ADDRESS + i);
+  }
+  check("no board config in EEPROM before the master sends one", config[1] != BOARD_CONFIG_VERSION);
+  config[1] = BOARD_CONFIG_VERSION;
+  config[2] = BOARD_COUNT;
+  for (uint8_t board = 0; board < BOARD_COUNT; ++board) {
+    uint8_t* boardConfig = config + 1 + BOARD_CONFIG_HEADER_SIZE + board * BOARD_CONFIG_BOARD_SIZE;
+    boardConfig[0] = board == BOARD_R2 ? BOARD_FEATURE_ENCODER : 0xFF;
+    boardConfig[1] = board == BOARD_L1 || board >= BOARD_R1 ? BOARD_CONFIG_FLAG_LOOP : 0;
+    boardConfig[2] = 0;
+    boardConfig[3] = board == BOARD_L1 ? 5 : BOARD_DESCRIPTORS[board].maxPosition;
+  }
+  config[configLength] = boardConfigChecksum(config + 1, configLength);
+  sim::writeToSlave(config, configLength + 1);
+  runLoop(10000);
+  checkLastValue("board config applied", CONTROL_TYPE_DEBUG, DEBUG_BOARD_CONFIG, BOARD_CONFIG_VERSION);
+  check("board config stored in EEPROM", isValidBoardConfig(&EEPROM.data[BOARD_CONFIG_EEPROM_ADDRESS], configLength, BOARD_COUNT));
+  turnEncoder(BOARD_L1, 3, 500);
+  runLoop(10000);
+  checkLastValue("L1 loops at the configured limit", CONTROL_TYPE_POSITION, BOARD_L1, 0);
+  const size_t configuredOffFrom = messages.size();
+  sim::setAnalog(SWR, SECOND_BUTTON_VOLTAGE);
+  runLoop(20000);
+  sim::setAnalog(SWR, 0);
+  runLoop(20000);
+  check("configured off R2 button sends nothing", countMessages(CONTROL_TYPE_BUTTON, BOARD_R2 * 20, configuredOffFrom) == 0);
+  config[configLength] ^= 1;
+  sim::writeToSlave(config, configLength + 1);
+  runLoop(10000);
+  checkLastValue("corrupt board config rejected", CONTROL_TYPE_DEBUG, DEBUG_BOARD_CONFIG, 0);
+
+  // Congested bus, every frame takes 20 ms: 20 position changes coalesce, the button edges don't
+  const SlaveToMasterMessage* positionBefore = lastMessage(CONTROL_TYPE_POSITION, BOARD_R1);
+  const uint16_t startPosition = positionBefore ? positionBefore->value : 0;
+  const size_t congestedFrom = messages.size();
+  setBusMicros(20000);
+  turnEncoder(BOARD_R1, 5, 500);
+  for (uint8_t i = 0; i < 2; ++i) {
+    sim::setAnalog(SWR, FIRST_BUTTON_VOLTAGE);
+    runLoop(20000);
+    sim::setAnalog(SWR, 0);
+    runLoop(20000);
+  }
+  turnEncoder(BOARD_R1, 5, 500);
+  turnEncoder(BOARD_R1, -10, 500);
+  runLoop(100000);
+  setBusMicros(0);
+  checkLastValue("congested R1 ends at the latest position", CONTROL_TYPE_POSITION, BOARD_R1, startPosition);
+  check("congested R1 positions coalesced", countMessages(CONTROL_TYPE_POSITION, BOARD_R1, congestedFrom) < 10);
+  check("congested R1 button edges all sent", countMessages(CONTROL_TYPE_BUTTON, BOARD_R1 * 20, congestedFrom) == 4);
+
+#ifdef MESSAGE_POLLING_ENABLED
+  // Every fault of the poll handshake hits the press frame: each button edge still arrives exactly
+  // once. With slow polls the release frame is ready when the acknowledgement is tried again, after
+  // the unconfirmed one that frame has the same length but not the same sequence bit.
+  const PollFault faults[] = {POLL_FAULT_ACK_LOST, POLL_FAULT_ACK_UNCONFIRMED, POLL_FAULT_SHORT_FRAME};
+  const char* faultChecks[] = {"R1 button edges sent once after a lost poll acknowledgement",
+    "R1 button edges sent once after an unconfirmed poll acknowledgement",
+    "R1 button edges sent again after a short frame read"};
+  for (uint8_t i = 0; i < sizeof(faults) / sizeof(faults[0]); ++i) {
+    const size_t faultFrom = messages.size();
+    const uint32_t syncErrorsBefore = pollSyncErrors;
+    pollFault = faults[i];
+    pollIntervalMicros = 30000;
+    sim::setAnalog(SWR, FIRST_BUTTON_VOLTAGE);
+    runLoop(40000);
+    sim::setAnalog(SWR, 0);
+    runLoop(40000);
+    pollIntervalMicros = 0;
+    runLoop(20000);
+    check(faultChecks[i], pollFault == POLL_FAULT_NONE && countMessages(CONTROL_TYPE_BUTTON, BOARD_R1 * 20, faultFrom) == 2 &&
+      pollSyncErrors - syncErrorsBefore == (faults[i] == POLL_FAULT_SHORT_FRAME ? 1 : 0));
+  }
+#else
+  // Frames that the master NACKs are sent again
+  const size_t nackedFrom = messages.size();
+  sim::setMasterNacks(2);
+  sim::setAnalog(SWR, FIRST_BUTTON_VOLTAGE);
+  runLoop(20000);
+  sim::setAnalog(SWR, 0);
+  runLoop(20000);
+  check("NACKed R1 button edges sent again", countMessages(CONTROL_TYPE_BUTTON, BOARD_R1 * 20, nackedFrom) == 2);
+#endif
+
+  // Time sync from the master, then an L1 turn waits behind a 20 ms frame of R1
+  check("general call enabled for the time sync", Wire.generalCall);
+  uint8_t sync[TIME_SYNC_SIZE];
+  writeTimeSync(sync, sim::nowMicros() + MASTER_CLOCK_OFFSET - TIME_SYNC_TRANSFER_MICROS);
+  sim::writeToSlave(sync, sizeof(sync));
+  setBusMicros(20000);
+  turnEncoder(BOARD_R1, 1, 500);
+  turnEncoder(BOARD_L1, 1, 500);
+  const uint32_t turnedMicros = sim::nowMicros() - 500;
+  runLoop(50000);
+  setBusMicros(0);
+  const SlaveToMasterMessage* turned = lastMessage(CONTROL_TYPE_POSITION, BOARD_L1);
+  const int32_t timestampError = turned ? (int32_t) (turned->time - MASTER_CLOCK_OFFSET - turnedMicros) : INT32_MAX;
+  check("detent timestamped with its pin edge in the master's clock", abs(timestampError) <= (int32_t) (2 << MESSAGE_TIME_SHIFT));
+
+  // A config change takes effect without a turn: R2 turned while absolute sends no delta once
+  // relative, R1 past its new maximum gets clamped
+  const SlaveToMasterMessage* r1Before = lastMessage(CONTROL_TYPE_POSITION, BOARD_R1);
+  turnEncoder(BOARD_R1, 5 - (r1Before ? r1Before->value : 0), 500);
+  turnEncoder(BOARD_R2, -4, 500);
+  runLoop(10000);
+  uint8_t* r1Config = config + 1 + BOARD_CONFIG_HEADER_SIZE + BOARD_R1 * BOARD_CONFIG_BOARD_SIZE;
+  r1Config[3] = 1;
+  // R2 relative: the deltas add up to the detents turned, a pass sends at most MAX_ENCODER_DELTA
+  uint8_t* r2Config = config + 1 + BOARD_CONFIG_HEADER_SIZE + BOARD_R2 * BOARD_CONFIG_BOARD_SIZE;
+  r2Config[1] = BOARD_CONFIG_FLAG_RELATIVE;
+  config[configLength] = boardConfigChecksum(config + 1, configLength);
+  size_t relativeFrom = messages.size();
+  sim::writeToSlave(config, configLength + 1);
+  runLoop(10000);
+  checkLastValue("relative R2 config applied", CONTROL_TYPE_DEBUG, DEBUG_BOARD_CONFIG, BOARD_CONFIG_VERSION);
+  check("relative R2 drops the detents turned while absolute", countMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == 0);
+  check("narrowed R1 limit applied at once", countMessages(CONTROL_TYPE_POSITION, BOARD_R1, relativeFrom) == 1);
+  checkLastValue("narrowed R1 clamped to its new maximum", CONTROL_TYPE_POSITION, BOARD_R1, 1);
+  relativeFrom = messages.size();
+  turnEncoder(BOARD_R2, 3, 500);
+  runLoop(10000);
+  check("relative R2 sends deltas", sumMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == 3);
+  // Turned between two passes, more than one message holds
+  relativeFrom = messages.size();
+  turnEncoder(BOARD_R2, 300, 0);
+  runLoop(1000);
+  check("fast relative R2 turn split over passes", sumMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == 300 &&
+    countMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == 3);
+  check("relative R2 deltas within a message", maxMessageMagnitude(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == MAX_ENCODER_DELTA);
+  relativeFrom = messages.size();
+  turnEncoder(BOARD_R2, -200, 0);
+  runLoop(1000);
+  check("fast relative R2 turn back", sumMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == -200);
+  // Past the wrap of the 16-bit step counter (AVR int), which a host int would hide
+  const int32_t wrapDetents = (int32_t) UINT16_MAX / 4 + 100;
+  relativeFrom = messages.size();
+  turnEncoder(BOARD_R2, wrapDetents, 0);
+  runLoop(20000);
+  check("relative R2 detents past the 16-bit wrap", wrapDetents > INT16_MAX / 4 && sumMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == wrapDetents);
+  relativeFrom = messages.size();
+  turnEncoder(BOARD_R2, 1, 500);
+  runLoop(10000);
+  check("relative R2 after the wrap", sumMessages(CONTROL_TYPE_ENCODER, BOARD_R2, relativeFrom) == 1);
+
+#ifdef PROFILER_ENABLED
+  // The sim's Timer1 does not count, only the calls are meaningful
+  const uint8_t profileRequest[PROFILE_REQUEST_SIZE] = {PROFILE_REQUEST_COMMAND, PROFILE_REQUEST_RESET};
+  sim::writeToSlave(profileRequest, sizeof(profileRequest));
+  runLoop(10000);
+  const SlaveToMasterMessage* updateCalls = lastMessage(CONTROL_TYPE_DEBUG, debugProfileInput(PROFILE_SECTION_UPDATE, PROFILE_STAT_CALLS));
+  const SlaveToMasterMessage* pcint2Calls = lastMessage(CONTROL_TYPE_DEBUG, debugProfileInput(PROFILE_SECTION_PCINT2, PROFILE_STAT_CALLS));
+  check("profile counts update() passes and encoder interrupts", updateCalls && updateCalls->value > 0 && pcint2Calls && pcint2Calls->value > 0);
+  check("profile answer complete", lastMessage(CONTROL_TYPE_DEBUG, debugProfileInput(PROFILE_SECTION_COUNT - 1, PROFILE_STAT_COUNT - 1)) != NULL);
+#endif
+
+  // Benchmark: the encoders turned back and forth in turn, one edge per loop() pass
+  const uint32_t messagesBefore = messages.size();
+  const uint32_t framesBefore = receivedFrames;
+  for (uint8_t i = 0; i < 50; ++i) {
+    for (uint8_t board = 0; board < BOARD_COUNT; ++board) {
+      turnEncoder((Board) board, i % 10 < 5 ? 1 : -1, LOOP_MICROS);
+    }
+  }
+  runLoop(10000);
+  printf("Benchmark: %u messages in %u frames\n", (uint32_t) messages.size() - messagesBefore, receivedFrames - framesBefore);
+#endif
+
+  printInterruptStats();
+  return failures;
+}